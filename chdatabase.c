@@ -47,7 +47,6 @@ static void allocBoards(void)
     chSetAllocatedBoardMove(2);
     chSetFreeBoardMove(0);
     chBoards.Move = utNewAInitFirst(chMove, chAllocatedBoardMove());
-    chBoards.MoveStackPos = utNewAInitFirst(uint32, (chAllocatedBoard()));
     chBoards.UndoMoveIndex_ = utNewAInitFirst(uint32, (chAllocatedBoard()));
     chBoards.NumUndoMove = utNewAInitFirst(uint32, (chAllocatedBoard()));
     chSetUsedBoardUndoMove(0);
@@ -55,8 +54,15 @@ static void allocBoards(void)
     chSetFreeBoardUndoMove(0);
     chBoards.UndoMove = utNewAInitFirst(chUndoMove, chAllocatedBoardUndoMove());
     chBoards.UndoMovePos = utNewAInitFirst(uint32, (chAllocatedBoard()));
-    chBoards.WhiteScore = utNewAInitFirst(int32, (chAllocatedBoard()));
-    chBoards.BlackScore = utNewAInitFirst(int32, (chAllocatedBoard()));
+    chBoards.WhiteScore = utNewAInitFirst(int64, (chAllocatedBoard()));
+    chBoards.BlackScore = utNewAInitFirst(int64, (chAllocatedBoard()));
+    chBoards.Bitboards = utNewAInitFirst(chBitboards, (chAllocatedBoard()));
+    chBoards.Accumulator = utNewAInitFirst(chAccumulator, (chAllocatedBoard()));
+    chBoards.Hash = utNewAInitFirst(uint64, (chAllocatedBoard()));
+    chBoards.PawnHash = utNewAInitFirst(uint64, (chAllocatedBoard()));
+    chBoards.EnPassantSquare = utNewAInitFirst(uint8, (chAllocatedBoard()));
+    chBoards.Phase = utNewAInitFirst(uint8, (chAllocatedBoard()));
+    chBoards.HalfMoveClock = utNewAInitFirst(uint16, (chAllocatedBoard()));
     chBoards.FirstPiece = utNewAInitFirst(chPiece, (chAllocatedBoard()));
     chBoards.LastPiece = utNewAInitFirst(chPiece, (chAllocatedBoard()));
 }
@@ -74,12 +80,18 @@ static void reallocBoards(
     utResizeArray(chBoards.BlackKing, (newSize));
     utResizeArray(chBoards.MoveIndex_, (newSize));
     utResizeArray(chBoards.NumMove, (newSize));
-    utResizeArray(chBoards.MoveStackPos, (newSize));
     utResizeArray(chBoards.UndoMoveIndex_, (newSize));
     utResizeArray(chBoards.NumUndoMove, (newSize));
     utResizeArray(chBoards.UndoMovePos, (newSize));
     utResizeArray(chBoards.WhiteScore, (newSize));
     utResizeArray(chBoards.BlackScore, (newSize));
+    utResizeArray(chBoards.Bitboards, (newSize));
+    utResizeArray(chBoards.Accumulator, (newSize));
+    utResizeArray(chBoards.Hash, (newSize));
+    utResizeArray(chBoards.PawnHash, (newSize));
+    utResizeArray(chBoards.EnPassantSquare, (newSize));
+    utResizeArray(chBoards.Phase, (newSize));
+    utResizeArray(chBoards.HalfMoveClock, (newSize));
     utResizeArray(chBoards.FirstPiece, (newSize));
     utResizeArray(chBoards.LastPiece, (newSize));
     chSetAllocatedBoard(newSize);
@@ -681,10 +693,14 @@ void chBoardCopyProps(
     chBoard newBoard)
 {
     chBoardSetPlayerWhite(newBoard, chBoardPlayerWhite(oldBoard));
-    chBoardSetMoveStackPos(newBoard, chBoardGetMoveStackPos(oldBoard));
     chBoardSetUndoMovePos(newBoard, chBoardGetUndoMovePos(oldBoard));
     chBoardSetWhiteScore(newBoard, chBoardGetWhiteScore(oldBoard));
     chBoardSetBlackScore(newBoard, chBoardGetBlackScore(oldBoard));
+    chBoardSetHash(newBoard, chBoardGetHash(oldBoard));
+    chBoardSetPawnHash(newBoard, chBoardGetPawnHash(oldBoard));
+    chBoardSetEnPassantSquare(newBoard, chBoardGetEnPassantSquare(oldBoard));
+    chBoardSetPhase(newBoard, chBoardGetPhase(oldBoard));
+    chBoardSetHalfMoveClock(newBoard, chBoardGetHalfMoveClock(oldBoard));
 }
 
 /*----------------------------------------------------------------------------------------
@@ -842,12 +858,8 @@ static void allocPieces(void)
 {
     chSetAllocatedPiece(2);
     chSetUsedPiece(1);
-    chPieces.Type = utNewAInitFirst(chPieceType, (chAllocatedPiece()));
-    chPieces.White = utNewAInitFirst(uint8, (chAllocatedPiece()));
-    chPieces.Row = utNewAInitFirst(uint32, (chAllocatedPiece()));
-    chPieces.Col = utNewAInitFirst(uint32, (chAllocatedPiece()));
-    chPieces.InPlay = utNewAInitFirst(uint8, (chAllocatedPiece()));
-    chPieces.NeverMoved = utNewAInitFirst(uint8, (chAllocatedPiece()));
+    chPieces.Square = utNewAInitFirst(uint8, (chAllocatedPiece()));
+    chPieces.Flags = utNewAInitFirst(uint8, (chAllocatedPiece()));
     chPieces.Board = utNewAInitFirst(chBoard, (chAllocatedPiece()));
     chPieces.NextBoardPiece = utNewAInitFirst(chPiece, (chAllocatedPiece()));
     chPieces.PrevBoardPiece = utNewAInitFirst(chPiece, (chAllocatedPiece()));
@@ -859,12 +871,8 @@ static void allocPieces(void)
 static void reallocPieces(
     uint32 newSize)
 {
-    utResizeArray(chPieces.Type, (newSize));
-    utResizeArray(chPieces.White, (newSize));
-    utResizeArray(chPieces.Row, (newSize));
-    utResizeArray(chPieces.Col, (newSize));
-    utResizeArray(chPieces.InPlay, (newSize));
-    utResizeArray(chPieces.NeverMoved, (newSize));
+    utResizeArray(chPieces.Square, (newSize));
+    utResizeArray(chPieces.Flags, (newSize));
     utResizeArray(chPieces.Board, (newSize));
     utResizeArray(chPieces.NextBoardPiece, (newSize));
     utResizeArray(chPieces.PrevBoardPiece, (newSize));
@@ -886,12 +894,8 @@ void chPieceCopyProps(
     chPiece oldPiece,
     chPiece newPiece)
 {
-    chPieceSetType(newPiece, chPieceGetType(oldPiece));
-    chPieceSetWhite(newPiece, chPieceWhite(oldPiece));
-    chPieceSetRow(newPiece, chPieceGetRow(oldPiece));
-    chPieceSetCol(newPiece, chPieceGetCol(oldPiece));
-    chPieceSetInPlay(newPiece, chPieceInPlay(oldPiece));
-    chPieceSetNeverMoved(newPiece, chPieceNeverMoved(oldPiece));
+    chPieceSetSquare(newPiece, chPieceGetSquare(oldPiece));
+    chPieceSetFlags(newPiece, chPieceGetFlags(oldPiece));
 }
 
 #if defined(DD_DEBUG)
@@ -919,21 +923,23 @@ void chDatabaseStop(void)
     utFree(chBoards.MoveIndex_);
     utFree(chBoards.NumMove);
     utFree(chBoards.Move);
-    utFree(chBoards.MoveStackPos);
     utFree(chBoards.UndoMoveIndex_);
     utFree(chBoards.NumUndoMove);
     utFree(chBoards.UndoMove);
     utFree(chBoards.UndoMovePos);
     utFree(chBoards.WhiteScore);
     utFree(chBoards.BlackScore);
+    utFree(chBoards.Bitboards);
+    utFree(chBoards.Accumulator);
+    utFree(chBoards.Hash);
+    utFree(chBoards.PawnHash);
+    utFree(chBoards.EnPassantSquare);
+    utFree(chBoards.Phase);
+    utFree(chBoards.HalfMoveClock);
     utFree(chBoards.FirstPiece);
     utFree(chBoards.LastPiece);
-    utFree(chPieces.Type);
-    utFree(chPieces.White);
-    utFree(chPieces.Row);
-    utFree(chPieces.Col);
-    utFree(chPieces.InPlay);
-    utFree(chPieces.NeverMoved);
+    utFree(chPieces.Square);
+    utFree(chPieces.Flags);
     utFree(chPieces.Board);
     utFree(chPieces.NextBoardPiece);
     utFree(chPieces.PrevBoardPiece);
@@ -949,7 +955,7 @@ void chDatabaseStart(void)
         utStart();
     }
     chRootData.hash = 0x83eb0015;
-    chModuleID = utRegisterModule("ch", false, chHash(), 2, 27, 1, sizeof(struct chRootType_),
+    chModuleID = utRegisterModule("ch", false, chHash(), 2, 29, 1, sizeof(struct chRootType_),
         &chRootData, chDatabaseStart, chDatabaseStop);
     utRegisterEnum("PieceType", 6);
     utRegisterEntry("CH_PAWN", 0);
@@ -958,7 +964,7 @@ void chDatabaseStart(void)
     utRegisterEntry("CH_BISHOP", 3);
     utRegisterEntry("CH_QUEEN", 4);
     utRegisterEntry("CH_KING", 5);
-    utRegisterClass("Board", 18, &chRootData.usedBoard, &chRootData.allocatedBoard,
+    utRegisterClass("Board", 24, &chRootData.usedBoard, &chRootData.allocatedBoard,
         NULL, 65535, 4, allocBoard, NULL);
     utRegisterField("PositionIndex_", &chBoards.PositionIndex_, sizeof(uint32), UT_UINT, NULL);
     utSetFieldHidden();
@@ -977,7 +983,6 @@ void chDatabaseStart(void)
     utRegisterField("Move", &chBoards.Move, sizeof(chMove), UT_TYPEDEF, NULL);
     utRegisterArray(&chRootData.usedBoardMove, &chRootData.allocatedBoardMove,
         getBoardMoves, allocBoardMoves, chCompactBoardMoves);
-    utRegisterField("MoveStackPos", &chBoards.MoveStackPos, sizeof(uint32), UT_UINT, NULL);
     utRegisterField("UndoMoveIndex_", &chBoards.UndoMoveIndex_, sizeof(uint32), UT_UINT, NULL);
     utSetFieldHidden();
     utRegisterField("NumUndoMove", &chBoards.NumUndoMove, sizeof(uint32), UT_UINT, NULL);
@@ -986,18 +991,21 @@ void chDatabaseStart(void)
     utRegisterArray(&chRootData.usedBoardUndoMove, &chRootData.allocatedBoardUndoMove,
         getBoardUndoMoves, allocBoardUndoMoves, chCompactBoardUndoMoves);
     utRegisterField("UndoMovePos", &chBoards.UndoMovePos, sizeof(uint32), UT_UINT, NULL);
-    utRegisterField("WhiteScore", &chBoards.WhiteScore, sizeof(int32), UT_INT, NULL);
-    utRegisterField("BlackScore", &chBoards.BlackScore, sizeof(int32), UT_INT, NULL);
+    utRegisterField("WhiteScore", &chBoards.WhiteScore, sizeof(int64), UT_INT, NULL);
+    utRegisterField("BlackScore", &chBoards.BlackScore, sizeof(int64), UT_INT, NULL);
+    utRegisterField("Bitboards", &chBoards.Bitboards, sizeof(chBitboards), UT_TYPEDEF, NULL);
+    utRegisterField("Accumulator", &chBoards.Accumulator, sizeof(chAccumulator), UT_TYPEDEF, NULL);
+    utRegisterField("Hash", &chBoards.Hash, sizeof(uint64), UT_UINT, NULL);
+    utRegisterField("PawnHash", &chBoards.PawnHash, sizeof(uint64), UT_UINT, NULL);
+    utRegisterField("EnPassantSquare", &chBoards.EnPassantSquare, sizeof(uint8), UT_UINT, NULL);
+    utRegisterField("Phase", &chBoards.Phase, sizeof(uint8), UT_UINT, NULL);
+    utRegisterField("HalfMoveClock", &chBoards.HalfMoveClock, sizeof(uint16), UT_UINT, NULL);
     utRegisterField("FirstPiece", &chBoards.FirstPiece, sizeof(chPiece), UT_POINTER, "Piece");
     utRegisterField("LastPiece", &chBoards.LastPiece, sizeof(chPiece), UT_POINTER, "Piece");
-    utRegisterClass("Piece", 9, &chRootData.usedPiece, &chRootData.allocatedPiece,
+    utRegisterClass("Piece", 5, &chRootData.usedPiece, &chRootData.allocatedPiece,
         NULL, 65535, 4, allocPiece, NULL);
-    utRegisterField("Type", &chPieces.Type, sizeof(chPieceType), UT_ENUM, "PieceType");
-    utRegisterField("White", &chPieces.White, sizeof(uint8), UT_BOOL, NULL);
-    utRegisterField("Row", &chPieces.Row, sizeof(uint32), UT_UINT, NULL);
-    utRegisterField("Col", &chPieces.Col, sizeof(uint32), UT_UINT, NULL);
-    utRegisterField("InPlay", &chPieces.InPlay, sizeof(uint8), UT_BOOL, NULL);
-    utRegisterField("NeverMoved", &chPieces.NeverMoved, sizeof(uint8), UT_BOOL, NULL);
+    utRegisterField("Square", &chPieces.Square, sizeof(uint8), UT_UINT, NULL);
+    utRegisterField("Flags", &chPieces.Flags, sizeof(uint8), UT_UINT, NULL);
     utRegisterField("Board", &chPieces.Board, sizeof(chBoard), UT_POINTER, "Board");
     utRegisterField("NextBoardPiece", &chPieces.NextBoardPiece, sizeof(chPiece), UT_POINTER, "Piece");
     utRegisterField("PrevBoardPiece", &chPieces.PrevBoardPiece, sizeof(chPiece), UT_POINTER, "Piece");
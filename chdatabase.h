@@ -129,13 +129,19 @@ struct chBoardFields {
     uint32 *MoveIndex_;
     uint32 *NumMove;
     chMove *Move;
-    uint32 *MoveStackPos;
     uint32 *UndoMoveIndex_;
     uint32 *NumUndoMove;
     chUndoMove *UndoMove;
     uint32 *UndoMovePos;
-    int32 *WhiteScore;
-    int32 *BlackScore;
+    int64 *WhiteScore;
+    int64 *BlackScore;
+    chBitboards *Bitboards;
+    chAccumulator *Accumulator;
+    uint64 *Hash;
+    uint64 *PawnHash;
+    uint8 *EnPassantSquare;
+    uint8 *Phase;
+    uint16 *HalfMoveClock;
     chPiece *FirstPiece;
     chPiece *LastPiece;
 };
@@ -321,8 +327,6 @@ utInlineC void chBoardSwapMoves(chBoard Board, uint32 from, uint32 to, uint32 co
     for(_xMove = 0; _xMove < chBoardGetNumMove(pVar); _xMove++) { \
         cVar = chBoardGetiMove(pVar, _xMove);
 #define chEndBoardMove }}
-utInlineC uint32 chBoardGetMoveStackPos(chBoard Board) {return chBoards.MoveStackPos[chBoard2ValidIndex(Board)];}
-utInlineC void chBoardSetMoveStackPos(chBoard Board, uint32 value) {chBoards.MoveStackPos[chBoard2ValidIndex(Board)] = value;}
 utInlineC uint32 chBoardGetUndoMoveIndex_(chBoard Board) {return chBoards.UndoMoveIndex_[chBoard2ValidIndex(Board)];}
 utInlineC void chBoardSetUndoMoveIndex_(chBoard Board, uint32 value) {chBoards.UndoMoveIndex_[chBoard2ValidIndex(Board)] = value;}
 utInlineC uint32 chBoardGetNumUndoMove(chBoard Board) {return chBoards.NumUndoMove[chBoard2ValidIndex(Board)];}
@@ -405,10 +409,24 @@ utInlineC void chBoardSwapUndoMoves(chBoard Board, uint32 from, uint32 to, uint3
 #define chEndBoardUndoMove }}
 utInlineC uint32 chBoardGetUndoMovePos(chBoard Board) {return chBoards.UndoMovePos[chBoard2ValidIndex(Board)];}
 utInlineC void chBoardSetUndoMovePos(chBoard Board, uint32 value) {chBoards.UndoMovePos[chBoard2ValidIndex(Board)] = value;}
-utInlineC int32 chBoardGetWhiteScore(chBoard Board) {return chBoards.WhiteScore[chBoard2ValidIndex(Board)];}
-utInlineC void chBoardSetWhiteScore(chBoard Board, int32 value) {chBoards.WhiteScore[chBoard2ValidIndex(Board)] = value;}
-utInlineC int32 chBoardGetBlackScore(chBoard Board) {return chBoards.BlackScore[chBoard2ValidIndex(Board)];}
-utInlineC void chBoardSetBlackScore(chBoard Board, int32 value) {chBoards.BlackScore[chBoard2ValidIndex(Board)] = value;}
+utInlineC int64 chBoardGetWhiteScore(chBoard Board) {return chBoards.WhiteScore[chBoard2ValidIndex(Board)];}
+utInlineC void chBoardSetWhiteScore(chBoard Board, int64 value) {chBoards.WhiteScore[chBoard2ValidIndex(Board)] = value;}
+utInlineC int64 chBoardGetBlackScore(chBoard Board) {return chBoards.BlackScore[chBoard2ValidIndex(Board)];}
+utInlineC void chBoardSetBlackScore(chBoard Board, int64 value) {chBoards.BlackScore[chBoard2ValidIndex(Board)] = value;}
+utInlineC chBitboards chBoardGetBitboards(chBoard Board) {return chBoards.Bitboards[chBoard2ValidIndex(Board)];}
+utInlineC void chBoardSetBitboards(chBoard Board, chBitboards value) {chBoards.Bitboards[chBoard2ValidIndex(Board)] = value;}
+utInlineC chAccumulator chBoardGetAccumulator(chBoard Board) {return chBoards.Accumulator[chBoard2ValidIndex(Board)];}
+utInlineC void chBoardSetAccumulator(chBoard Board, chAccumulator value) {chBoards.Accumulator[chBoard2ValidIndex(Board)] = value;}
+utInlineC uint64 chBoardGetHash(chBoard Board) {return chBoards.Hash[chBoard2ValidIndex(Board)];}
+utInlineC void chBoardSetHash(chBoard Board, uint64 value) {chBoards.Hash[chBoard2ValidIndex(Board)] = value;}
+utInlineC uint64 chBoardGetPawnHash(chBoard Board) {return chBoards.PawnHash[chBoard2ValidIndex(Board)];}
+utInlineC void chBoardSetPawnHash(chBoard Board, uint64 value) {chBoards.PawnHash[chBoard2ValidIndex(Board)] = value;}
+utInlineC uint8 chBoardGetEnPassantSquare(chBoard Board) {return chBoards.EnPassantSquare[chBoard2ValidIndex(Board)];}
+utInlineC void chBoardSetEnPassantSquare(chBoard Board, uint8 value) {chBoards.EnPassantSquare[chBoard2ValidIndex(Board)] = value;}
+utInlineC uint8 chBoardGetPhase(chBoard Board) {return chBoards.Phase[chBoard2ValidIndex(Board)];}
+utInlineC void chBoardSetPhase(chBoard Board, uint8 value) {chBoards.Phase[chBoard2ValidIndex(Board)] = value;}
+utInlineC uint16 chBoardGetHalfMoveClock(chBoard Board) {return chBoards.HalfMoveClock[chBoard2ValidIndex(Board)];}
+utInlineC void chBoardSetHalfMoveClock(chBoard Board, uint16 value) {chBoards.HalfMoveClock[chBoard2ValidIndex(Board)] = value;}
 utInlineC chPiece chBoardGetFirstPiece(chBoard Board) {return chBoards.FirstPiece[chBoard2ValidIndex(Board)];}
 utInlineC void chBoardSetFirstPiece(chBoard Board, chPiece value) {chBoards.FirstPiece[chBoard2ValidIndex(Board)] = value;}
 utInlineC chPiece chBoardGetLastPiece(chBoard Board) {return chBoards.LastPiece[chBoard2ValidIndex(Board)];}
@@ -444,13 +462,19 @@ utInlineC chBoard chBoardAlloc(void) {
     chBoardSetMoveIndex_(Board, 0);
     chBoardSetNumMove(Board, 0);
     chBoardSetNumMove(Board, 0);
-    chBoardSetMoveStackPos(Board, 0);
     chBoardSetUndoMoveIndex_(Board, 0);
     chBoardSetNumUndoMove(Board, 0);
     chBoardSetNumUndoMove(Board, 0);
     chBoardSetUndoMovePos(Board, 0);
     chBoardSetWhiteScore(Board, 0);
     chBoardSetBlackScore(Board, 0);
+    memset(chBoards.Bitboards + chBoard2ValidIndex(Board), 0, sizeof(chBitboards));
+    memset(chBoards.Accumulator + chBoard2ValidIndex(Board), 0, sizeof(chAccumulator));
+    chBoardSetHash(Board, 0);
+    chBoardSetPawnHash(Board, 0);
+    chBoardSetEnPassantSquare(Board, 0);
+    chBoardSetPhase(Board, 0);
+    chBoardSetHalfMoveClock(Board, 0);
     chBoardSetFirstPiece(Board, chPieceNull);
     chBoardSetLastPiece(Board, chPieceNull);
     if(chBoardConstructorCallback != NULL) {
@@ -462,12 +486,8 @@ utInlineC chBoard chBoardAlloc(void) {
   Fields for class Piece.
 ----------------------------------------------------------------------------------------*/
 struct chPieceFields {
-    chPieceType *Type;
-    uint8 *White;
-    uint32 *Row;
-    uint32 *Col;
-    uint8 *InPlay;
-    uint8 *NeverMoved;
+    uint8 *Square;
+    uint8 *Flags;
     chBoard *Board;
     chPiece *NextBoardPiece;
     chPiece *PrevBoardPiece;
@@ -476,18 +496,10 @@ extern struct chPieceFields chPieces;
 
 void chPieceAllocMore(void);
 void chPieceCopyProps(chPiece chOldPiece, chPiece chNewPiece);
-utInlineC chPieceType chPieceGetType(chPiece Piece) {return chPieces.Type[chPiece2ValidIndex(Piece)];}
-utInlineC void chPieceSetType(chPiece Piece, chPieceType value) {chPieces.Type[chPiece2ValidIndex(Piece)] = value;}
-utInlineC uint8 chPieceWhite(chPiece Piece) {return chPieces.White[chPiece2ValidIndex(Piece)];}
-utInlineC void chPieceSetWhite(chPiece Piece, uint8 value) {chPieces.White[chPiece2ValidIndex(Piece)] = value;}
-utInlineC uint32 chPieceGetRow(chPiece Piece) {return chPieces.Row[chPiece2ValidIndex(Piece)];}
-utInlineC void chPieceSetRow(chPiece Piece, uint32 value) {chPieces.Row[chPiece2ValidIndex(Piece)] = value;}
-utInlineC uint32 chPieceGetCol(chPiece Piece) {return chPieces.Col[chPiece2ValidIndex(Piece)];}
-utInlineC void chPieceSetCol(chPiece Piece, uint32 value) {chPieces.Col[chPiece2ValidIndex(Piece)] = value;}
-utInlineC uint8 chPieceInPlay(chPiece Piece) {return chPieces.InPlay[chPiece2ValidIndex(Piece)];}
-utInlineC void chPieceSetInPlay(chPiece Piece, uint8 value) {chPieces.InPlay[chPiece2ValidIndex(Piece)] = value;}
-utInlineC uint8 chPieceNeverMoved(chPiece Piece) {return chPieces.NeverMoved[chPiece2ValidIndex(Piece)];}
-utInlineC void chPieceSetNeverMoved(chPiece Piece, uint8 value) {chPieces.NeverMoved[chPiece2ValidIndex(Piece)] = value;}
+utInlineC uint8 chPieceGetSquare(chPiece Piece) {return chPieces.Square[chPiece2ValidIndex(Piece)];}
+utInlineC void chPieceSetSquare(chPiece Piece, uint8 value) {chPieces.Square[chPiece2ValidIndex(Piece)] = value;}
+utInlineC uint8 chPieceGetFlags(chPiece Piece) {return chPieces.Flags[chPiece2ValidIndex(Piece)];}
+utInlineC void chPieceSetFlags(chPiece Piece, uint8 value) {chPieces.Flags[chPiece2ValidIndex(Piece)] = value;}
 utInlineC chBoard chPieceGetBoard(chPiece Piece) {return chPieces.Board[chPiece2ValidIndex(Piece)];}
 utInlineC void chPieceSetBoard(chPiece Piece, chBoard value) {chPieces.Board[chPiece2ValidIndex(Piece)] = value;}
 utInlineC chPiece chPieceGetNextBoardPiece(chPiece Piece) {return chPieces.NextBoardPiece[chPiece2ValidIndex(Piece)];}
@@ -516,12 +528,8 @@ utInlineC chPiece chPieceAllocRaw(void) {
     return Piece;}
 utInlineC chPiece chPieceAlloc(void) {
     chPiece Piece = chPieceAllocRaw();
-    chPieceSetType(Piece, CH_PAWN);
-    chPieceSetWhite(Piece, 0);
-    chPieceSetRow(Piece, 0);
-    chPieceSetCol(Piece, 0);
-    chPieceSetInPlay(Piece, 0);
-    chPieceSetNeverMoved(Piece, 0);
+    chPieceSetSquare(Piece, 0);
+    chPieceSetFlags(Piece, 0);
     chPieceSetBoard(Piece, chBoardNull);
     chPieceSetNextBoardPiece(Piece, chPieceNull);
     chPieceSetPrevBoardPiece(Piece, chPieceNull);
@@ -1,29 +1,199 @@
 #include <stdlib.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <pthread.h>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
 #include <readline/readline.h>
 #include "chdatabase.h"
 
 #define ROWS 8
 #define COLS 8
 #define MAX_GAME_MOVES 4096
-// This is used to indicated winning by taking the king.
+#define MAX_DIFFICULTY 63
+#define MAX_MOVES 256  // More than the pseudo-legal moves in any position.
+#define BENCH_DIFFICULTY 5
+#define MAX_FEN_LENGTH 128
+#define MAX_MOVE_TEXT 8
+#define START_FEN "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1"
+#define MAX_SEARCH_DEPTH 1024  // Difficulty plus the longest capture sequence.
+// The score for checkmate.  The search adds the depth left, to prefer mating
+// sooner.
 #define WIN 10000000
+// A piece's type, colour and state are packed into its flags byte.
+#define PIECE_TYPE 0x07
+#define PIECE_WHITE 0x08
+#define PIECE_IN_PLAY 0x10
+#define PIECE_NEVER_MOVED 0x20
 
-// Return a score for a piece.
-static inline uint32 findPieceScore(chPiece piece) {
-    bool white = chPieceWhite(piece);
-    // Slight bias to march pieces forward.
-    uint8 advance = white? chPieceGetRow(piece) : 7 - chPieceGetRow(piece);
-    switch (chPieceGetType(piece)) {
-        case CH_PAWN: return 1000 + advance;
-        case CH_ROOK: return 5000 + advance;
-        case CH_KNIGHT: return 3000 + advance;
-        case CH_BISHOP: return 3000 + advance;
-        case CH_QUEEN: return 10000 + advance;
-        case CH_KING: return 0;  // The special cost WIN is used when taking the king.
-        default:
-            utExit("Unknown piece type.");
+// Return the piece's type.
+static inline chPieceType getPieceType(chPiece piece) {
+    return chPieceGetFlags(piece) & PIECE_TYPE;
+}
+
+// Return true if the piece is white.
+static inline bool pieceWhite(chPiece piece) {
+    return chPieceGetFlags(piece) & PIECE_WHITE;
+}
+
+// Return true if the piece is on the board.
+static inline bool pieceInPlay(chPiece piece) {
+    return chPieceGetFlags(piece) & PIECE_IN_PLAY;
+}
+
+// Return true if the piece has not moved, for castling and pawn double pushes.
+static inline bool pieceNeverMoved(chPiece piece) {
+    return chPieceGetFlags(piece) & PIECE_NEVER_MOVED;
+}
+
+// Return the piece's row.  Its square is only meaningful while it is in play.
+static inline uint8 getPieceRow(chPiece piece) {
+    return chPieceGetSquare(piece) / COLS;
+}
+
+// Return the piece's column.
+static inline uint8 getPieceCol(chPiece piece) {
+    return chPieceGetSquare(piece) % COLS;
+}
+
+// Set or clear one of the piece's flags.
+static inline void setPieceFlag(chPiece piece, uint8 flag, bool value) {
+    uint8 flags = chPieceGetFlags(piece);
+    chPieceSetFlags(piece, value? flags | flag : flags & ~flag);
+}
+
+// Set the piece's type.
+static inline void setPieceType(chPiece piece, chPieceType type) {
+    chPieceSetFlags(piece, (chPieceGetFlags(piece) & ~PIECE_TYPE) | type);
+}
+
+// Piece values in millipawns, indexed by chPieceType.  Kings are never taken.
+static const int32 pieceValues[] = {1000, 5000, 3000, 3000, 10000, 0};
+
+// Piece-square tables in centipawns, from white's side, with row 7 first so
+// they read like a board.  Black uses them mirrored.  Pawns and kings play
+// differently in the endgame, so they have their own endgame tables: pawns
+// gain by advancing, and the king comes out to the center.
+static const int8 pawnMiddlegameTable[] = {
+      0,   0,   0,   0,   0,   0,   0,   0,
+     50,  50,  50,  50,  50,  50,  50,  50,
+     10,  10,  20,  30,  30,  20,  10,  10,
+      5,   5,  10,  25,  25,  10,   5,   5,
+      0,   0,   0,  20,  20,   0,   0,   0,
+      5,  -5, -10,   0,   0, -10,  -5,   5,
+      5,  10,  10, -20, -20,  10,  10,   5,
+      0,   0,   0,   0,   0,   0,   0,   0};
+static const int8 pawnEndgameTable[] = {
+      0,   0,   0,   0,   0,   0,   0,   0,
+     80,  80,  80,  80,  80,  80,  80,  80,
+     50,  50,  50,  50,  50,  50,  50,  50,
+     30,  30,  30,  30,  30,  30,  30,  30,
+     20,  20,  20,  20,  20,  20,  20,  20,
+     10,  10,  10,  10,  10,  10,  10,  10,
+      0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0};
+static const int8 rookTable[] = {
+      0,   0,   0,   0,   0,   0,   0,   0,
+      5,  10,  10,  10,  10,  10,  10,   5,
+     -5,   0,   0,   0,   0,   0,   0,  -5,
+     -5,   0,   0,   0,   0,   0,   0,  -5,
+     -5,   0,   0,   0,   0,   0,   0,  -5,
+     -5,   0,   0,   0,   0,   0,   0,  -5,
+     -5,   0,   0,   0,   0,   0,   0,  -5,
+      0,   0,   0,   5,   5,   0,   0,   0};
+static const int8 knightTable[] = {
+    -50, -40, -30, -30, -30, -30, -40, -50,
+    -40, -20,   0,   0,   0,   0, -20, -40,
+    -30,   0,  10,  15,  15,  10,   0, -30,
+    -30,   5,  15,  20,  20,  15,   5, -30,
+    -30,   0,  15,  20,  20,  15,   0, -30,
+    -30,   5,  10,  15,  15,  10,   5, -30,
+    -40, -20,   0,   5,   5,   0, -20, -40,
+    -50, -40, -30, -30, -30, -30, -40, -50};
+static const int8 bishopTable[] = {
+    -20, -10, -10, -10, -10, -10, -10, -20,
+    -10,   0,   0,   0,   0,   0,   0, -10,
+    -10,   0,   5,  10,  10,   5,   0, -10,
+    -10,   5,   5,  10,  10,   5,   5, -10,
+    -10,   0,  10,  10,  10,  10,   0, -10,
+    -10,  10,  10,  10,  10,  10,  10, -10,
+    -10,   5,   0,   0,   0,   0,   5, -10,
+    -20, -10, -10, -10, -10, -10, -10, -20};
+static const int8 queenTable[] = {
+    -20, -10, -10,  -5,  -5, -10, -10, -20,
+    -10,   0,   0,   0,   0,   0,   0, -10,
+    -10,   0,   5,   5,   5,   5,   0, -10,
+     -5,   0,   5,   5,   5,   5,   0,  -5,
+      0,   0,   5,   5,   5,   5,   0,  -5,
+    -10,   5,   5,   5,   5,   5,   0, -10,
+    -10,   0,   5,   0,   0,   0,   0, -10,
+    -20, -10, -10,  -5,  -5, -10, -10, -20};
+static const int8 kingMiddlegameTable[] = {
+    -30, -40, -40, -50, -50, -40, -40, -30,
+    -30, -40, -40, -50, -50, -40, -40, -30,
+    -30, -40, -40, -50, -50, -40, -40, -30,
+    -30, -40, -40, -50, -50, -40, -40, -30,
+    -20, -30, -30, -40, -40, -30, -30, -20,
+    -10, -20, -20, -20, -20, -20, -20, -10,
+     20,  20,   0,   0,   0,   0,  20,  20,
+     20,  30,  10,   0,   0,  10,  30,  20};
+static const int8 kingEndgameTable[] = {
+    -50, -40, -30, -20, -20, -30, -40, -50,
+    -30, -20, -10,   0,   0, -10, -20, -30,
+    -30, -10,  20,  30,  30,  20, -10, -30,
+    -30, -10,  30,  40,  40,  30, -10, -30,
+    -30, -10,  30,  40,  40,  30, -10, -30,
+    -30, -10,  20,  30,  30,  20, -10, -30,
+    -30, -30,   0,   0,   0,   0, -30, -30,
+    -50, -30, -30, -30, -30, -30, -30, -50};
+static const int8 *const middlegameTables[] = {pawnMiddlegameTable, rookTable, knightTable, bishopTable,
+    queenTable, kingMiddlegameTable};
+static const int8 *const endgameTables[] = {pawnEndgameTable, rookTable, knightTable, bishopTable,
+    queenTable, kingEndgameTable};
+
+// Each side's score is a middlegame and an endgame score packed into one
+// number, so both are kept up to date with a single add.  The endgame score is
+// in the high 32 bits.
+#define makeScore(middlegame, endgame) ((int64)(endgame)*((int64)1 << 32) + (middlegame))
+
+// Return the middlegame half of a packed score.
+static inline int32 middlegameScore(int64 score) {
+    return (int32)(uint32)score;
+}
+
+// Return the endgame half of a packed score.
+static inline int32 endgameScore(int64 score) {
+    return (int32)((score + ((int64)1 << 31)) >> 32);
+}
+
+// The game phase counts the pieces other than pawns and kings, weighted by
+// these, indexed by chPieceType.  MAX_PHASE is a full middlegame, and 0 a pawn
+// endgame.
+static const uint8 phaseWeights[] = {0, 2, 1, 1, 4, 0};
+#define MAX_PHASE 24
+
+// Packed material plus piece-square scores, filled in by initPieceSquareScores.
+static int64 pieceSquareScores[2][6][ROWS*COLS];  // Indexed by [white][type][square].
+
+// Fill in the packed piece-square scores.
+static void initPieceSquareScores(void) {
+    for (uint8 white = 0; white < 2; white++) {
+        for (uint8 type = CH_PAWN; type <= CH_KING; type++) {
+            for (uint8 square = 0; square < ROWS*COLS; square++) {
+                uint8 row = square / COLS;
+                uint8 index = COLS*(white? ROWS - 1 - row : row) + square % COLS;
+                pieceSquareScores[white][type][square] =
+                    makeScore(pieceValues[type] + 10*middlegameTables[type][index],
+                        pieceValues[type] + 10*endgameTables[type][index]);
+            }
+        }
     }
-    return 0;  // Dummy return.
+}
+
+// Return the packed score for a piece on its square.
+static inline int64 findPieceScore(chPiece piece) {
+    return pieceSquareScores[pieceWhite(piece)][getPieceType(piece)][chPieceGetSquare(piece)];
 }
 
 // Return name of the piece type.
@@ -51,39 +221,531 @@ static inline bool squareEmpty(chBoard board, uint8 row, uint8 col) {
     return getPieceAtPosition(board, row, col) == chPieceNull;
 }
 
-// Verify the computed score.
+// Verify the computed scores and game phase.
 void verifyScore(chBoard board) {
     chPiece piece;
-    uint32 whiteScore = 0;
-    uint32 blackScore = 0;
+    int64 whiteScore = 0;
+    int64 blackScore = 0;
+    uint8 phase = 0;
     chForeachBoardPiece(board, piece) {
-        if (chPieceInPlay(piece)) {
-            if (chPieceWhite(piece)) {
+        if (pieceInPlay(piece)) {
+            if (pieceWhite(piece)) {
                 whiteScore += findPieceScore(piece);
             } else {
                 blackScore += findPieceScore(piece);
             }
+            phase += phaseWeights[getPieceType(piece)];
         }
     } chEndBoardPiece;
     utAssert(whiteScore == chBoardGetWhiteScore(board));
     utAssert(blackScore == chBoardGetBlackScore(board));
+    utAssert(phase == chBoardGetPhase(board));
+}
+
+// Return the board's bitboards, so they can be updated in place.
+static inline chBitboards *getBitboards(chBoard board) {
+    return chBoards.Bitboards + chBoard2ValidIndex(board);
+}
+
+// Return a bitboard with only the square at (row, col) set.
+static inline uint64 squareBit(uint8 row, uint8 col) {
+    return (uint64)1 << (COLS*row + col);
+}
+
+// Move flags, in the top 4 bits of a chMove.  Promotions also hold the new
+// piece type.
+#define MOVE_CASTLE 0x1000
+#define MOVE_EN_PASSANT 0x2000
+#define MOVE_PROMOTION 0x8000
+#define MOVE_FLAGS 0xf000
+#define NULL_MOVE 0
+
+// Return a move from square from to square to.
+static inline chMove encodeMove(uint8 from, uint8 to, uint16 flags) {
+    return from | (to << 6) | flags;
+}
+
+// Return the move's from square.
+static inline uint8 moveFrom(chMove move) {
+    return move & 0x3f;
+}
+
+// Return the move's to square.
+static inline uint8 moveTo(chMove move) {
+    return (move >> 6) & 0x3f;
+}
+
+// Return the row of the move's from square.
+static inline uint8 moveFromRow(chMove move) {
+    return moveFrom(move) / COLS;
+}
+
+// Return the column of the move's from square.
+static inline uint8 moveFromCol(chMove move) {
+    return moveFrom(move) % COLS;
+}
+
+// Return the row of the move's to square.
+static inline uint8 moveToRow(chMove move) {
+    return moveTo(move) / COLS;
+}
+
+// Return the column of the move's to square.
+static inline uint8 moveToCol(chMove move) {
+    return moveTo(move) % COLS;
+}
+
+// Return the piece type a pawn is promoted to.  Only valid if the move has the
+// MOVE_PROMOTION flag.
+static inline chPieceType movePromotionType(chMove move) {
+    return (move >> 12) & 0x7;
+}
+
+// Return the promotion flags for promoting to the piece type.
+static inline uint16 promotionFlags(chPieceType type) {
+    return MOVE_PROMOTION | (type << 12);
+}
+
+// The moves found in one position.  Each ply of the search keeps its own list
+// on the stack.
+struct chMoveList_st {
+    uint32 numMoves;
+    chMove moves[MAX_MOVES];
+};
+
+typedef struct chMoveList_st chMoveList;
+
+// Directions sliding pieces can move in.  The first four move towards higher
+// square numbers, and the last four towards lower ones.
+enum {NORTH, NORTH_EAST, EAST, NORTH_WEST, SOUTH, SOUTH_WEST, WEST, SOUTH_EAST, NUM_DIRECTIONS};
+
+#define RANK_3 ((uint64)0xff << 16)
+#define RANK_6 ((uint64)0xff << 40)
+
+// Attack tables, indexed by square, computed once by initAttackTables.
+static uint64 rayAttacks[NUM_DIRECTIONS][ROWS*COLS];
+static uint64 knightAttacks[ROWS*COLS];
+static uint64 kingAttacks[ROWS*COLS];
+static uint64 pawnAttacks[2][ROWS*COLS];  // Indexed by [white][square].
+// The squares strictly between two squares on a line, and all the squares on
+// the line through them, indexed by [square][square].  Empty if not on a line.
+static uint64 betweenSquares[ROWS*COLS][ROWS*COLS];
+static uint64 lineSquares[ROWS*COLS][ROWS*COLS];
+// The squares a rook or bishop attacks from a square on an empty board.
+static uint64 rookRays[ROWS*COLS];
+static uint64 bishopRays[ROWS*COLS];
+
+// Return the bitboard of squares reached from (row, col) by each pair of deltas.
+static uint64 findDeltaAttacks(uint8 row, uint8 col, int8 *deltas, uint8 deltasLen) {
+    uint64 attacks = 0;
+    for (uint8 i = 0; i < deltasLen; i += 2) {
+        int8 toRow = row + deltas[i];
+        int8 toCol = col + deltas[i + 1];
+        if (toRow >= 0 && toRow < ROWS && toCol >= 0 && toCol < COLS) {
+            attacks |= squareBit(toRow, toCol);
+        }
+    }
+    return attacks;
+}
+
+// Fill in the attack tables used by the bitboard move generator.
+static void initAttackTables(void) {
+    int8 knightDeltas[] = {-2, -1, -2, 1, -1, -2, -1, 2, 1, -2, 1, 2, 2, -1, 2, 1};
+    int8 kingDeltas[] = {-1, -1, -1, 0, -1, 1, 0, -1, 0, 1, 1, -1, 1, 0, 1, 1};
+    int8 whitePawnDeltas[] = {1, -1, 1, 1};
+    int8 blackPawnDeltas[] = {-1, -1, -1, 1};
+    int8 rowDeltas[NUM_DIRECTIONS] = {1, 1, 0, 1, -1, -1, 0, -1};
+    int8 colDeltas[NUM_DIRECTIONS] = {0, 1, 1, -1, 0, -1, -1, 1};
+    for (uint8 row = 0; row < ROWS; row++) {
+        for (uint8 col = 0; col < COLS; col++) {
+            uint8 square = COLS*row + col;
+            knightAttacks[square] = findDeltaAttacks(row, col, knightDeltas, sizeof(knightDeltas));
+            kingAttacks[square] = findDeltaAttacks(row, col, kingDeltas, sizeof(kingDeltas));
+            pawnAttacks[true][square] = findDeltaAttacks(row, col, whitePawnDeltas, sizeof(whitePawnDeltas));
+            pawnAttacks[false][square] = findDeltaAttacks(row, col, blackPawnDeltas, sizeof(blackPawnDeltas));
+            for (uint8 dir = 0; dir < NUM_DIRECTIONS; dir++) {
+                uint64 ray = 0;
+                int8 toRow = row + rowDeltas[dir];
+                int8 toCol = col + colDeltas[dir];
+                while (toRow >= 0 && toRow < ROWS && toCol >= 0 && toCol < COLS) {
+                    ray |= squareBit(toRow, toCol);
+                    toRow += rowDeltas[dir];
+                    toCol += colDeltas[dir];
+                }
+                rayAttacks[dir][square] = ray;
+            }
+        }
+    }
+    for (uint8 square = 0; square < ROWS*COLS; square++) {
+        rookRays[square] = rayAttacks[NORTH][square] | rayAttacks[EAST][square] |
+            rayAttacks[SOUTH][square] | rayAttacks[WEST][square];
+        bishopRays[square] = rayAttacks[NORTH_EAST][square] | rayAttacks[NORTH_WEST][square] |
+            rayAttacks[SOUTH_EAST][square] | rayAttacks[SOUTH_WEST][square];
+        for (uint8 dir = 0; dir < NUM_DIRECTIONS; dir++) {
+            uint64 ray = rayAttacks[dir][square];
+            uint64 line = ray | rayAttacks[(dir + SOUTH) % NUM_DIRECTIONS][square] | ((uint64)1 << square);
+            for (uint64 targets = ray; targets != 0; targets &= targets - 1) {
+                uint8 target = __builtin_ctzll(targets);
+                betweenSquares[square][target] = ray & ~rayAttacks[dir][target] & ~((uint64)1 << target);
+                lineSquares[square][target] = line;
+            }
+        }
+    }
+}
+
+// Return the lowest numbered square in a non-empty bitboard.
+static inline uint8 firstSquare(uint64 bits) {
+    return __builtin_ctzll(bits);
+}
+
+// Efficiently updatable neural network (NNUE) evaluation, used instead of the
+// hand-written evaluation when a network is loaded with -nnue.  The input
+// features are the pieces on their squares, seen from each side's point of
+// view: for black the board is mirrored top to bottom and the colours swapped,
+// so a side's own pawns always move up.  The first layer's sums live in the
+// board's accumulator.  At evaluation, the side to move's and the other side's
+// sums are clipped to 0..NNUE_QA and fed to a single output.  The int16
+// arithmetic uses AVX2 or SSE2 when the compiler targets them.
+#define NNUE_FEATURES (2*6*ROWS*COLS)
+#define NNUE_QA 255  // The first layer's fixed-point 1.0.
+#define NNUE_QB 64  // The output weights' fixed-point 1.0.
+#define NNUE_SCALE 4000  // Millipawns per unit of network output.
+
+struct chNetwork_st {
+    int16 featureWeights[NNUE_FEATURES][NNUE_HIDDEN];
+    int16 featureBiases[NNUE_HIDDEN];
+    int16 outputWeights[2][NNUE_HIDDEN];  // The side to move's, then the other side's.
+    int32 outputBias;
+};
+
+typedef struct chNetwork_st chNetwork;
+
+static chNetwork *network;  // NULL unless one was loaded.
+
+// Return the board's accumulator, so it can be updated in place.
+static inline chAccumulator *getAccumulator(chBoard board) {
+    return chBoards.Accumulator + chBoard2ValidIndex(board);
+}
+
+// Return the input feature for a piece, from the perspective side's view.
+static inline uint32 findFeature(bool perspective, bool white, chPieceType type, uint8 square) {
+    if (!perspective) {
+        square ^= COLS*(ROWS - 1);  // Mirror the row.
+    }
+    return ((white == perspective? 0 : 6) + type)*ROWS*COLS + square;
+}
+
+// Add the weights to the accumulator values.
+static inline void addWeights(int16 *values, const int16 *weights) {
+#if defined(__AVX2__)
+    for (uint32 i = 0; i < NNUE_HIDDEN; i += 16) {
+        __m256i sum = _mm256_add_epi16(_mm256_loadu_si256((__m256i *)(values + i)),
+            _mm256_loadu_si256((__m256i *)(weights + i)));
+        _mm256_storeu_si256((__m256i *)(values + i), sum);
+    }
+#elif defined(__SSE2__)
+    for (uint32 i = 0; i < NNUE_HIDDEN; i += 8) {
+        __m128i sum = _mm_add_epi16(_mm_loadu_si128((__m128i *)(values + i)),
+            _mm_loadu_si128((__m128i *)(weights + i)));
+        _mm_storeu_si128((__m128i *)(values + i), sum);
+    }
+#else
+    for (uint32 i = 0; i < NNUE_HIDDEN; i++) {
+        values[i] += weights[i];
+    }
+#endif
+}
+
+// Subtract the weights from the accumulator values.
+static inline void subtractWeights(int16 *values, const int16 *weights) {
+#if defined(__AVX2__)
+    for (uint32 i = 0; i < NNUE_HIDDEN; i += 16) {
+        __m256i difference = _mm256_sub_epi16(_mm256_loadu_si256((__m256i *)(values + i)),
+            _mm256_loadu_si256((__m256i *)(weights + i)));
+        _mm256_storeu_si256((__m256i *)(values + i), difference);
+    }
+#elif defined(__SSE2__)
+    for (uint32 i = 0; i < NNUE_HIDDEN; i += 8) {
+        __m128i difference = _mm_sub_epi16(_mm_loadu_si128((__m128i *)(values + i)),
+            _mm_loadu_si128((__m128i *)(weights + i)));
+        _mm_storeu_si128((__m128i *)(values + i), difference);
+    }
+#else
+    for (uint32 i = 0; i < NNUE_HIDDEN; i++) {
+        values[i] -= weights[i];
+    }
+#endif
+}
+
+// Add or remove the piece's features on the square in the accumulator.
+static inline void updateAccumulator(chBoard board, chPiece piece, uint8 square, bool add) {
+    chAccumulator *accumulator = getAccumulator(board);
+    bool white = pieceWhite(piece);
+    chPieceType type = getPieceType(piece);
+    for (uint8 perspective = 0; perspective < 2; perspective++) {
+        const int16 *weights = network->featureWeights[findFeature(perspective, white, type, square)];
+        if (add) {
+            addWeights(accumulator->values[perspective], weights);
+        } else {
+            subtractWeights(accumulator->values[perspective], weights);
+        }
+    }
+}
+
+// Return the dot product of the output weights with the first layer's
+// outputs: the accumulator values plus the biases, clipped to 0..NNUE_QA.
+static inline int32 findOutputSum(const int16 *values, const int16 *biases, const int16 *weights) {
+#if defined(__AVX2__)
+    __m256i zero = _mm256_setzero_si256();
+    __m256i one = _mm256_set1_epi16(NNUE_QA);
+    __m256i sums = zero;
+    for (uint32 i = 0; i < NNUE_HIDDEN; i += 16) {
+        __m256i x = _mm256_add_epi16(_mm256_loadu_si256((__m256i *)(values + i)),
+            _mm256_loadu_si256((__m256i *)(biases + i)));
+        x = _mm256_min_epi16(_mm256_max_epi16(x, zero), one);
+        sums = _mm256_add_epi32(sums, _mm256_madd_epi16(x, _mm256_loadu_si256((__m256i *)(weights + i))));
+    }
+    __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(sums), _mm256_extracti128_si256(sums, 1));
+#elif defined(__SSE2__)
+    __m128i zero = _mm_setzero_si128();
+    __m128i one = _mm_set1_epi16(NNUE_QA);
+    __m128i sum = zero;
+    for (uint32 i = 0; i < NNUE_HIDDEN; i += 8) {
+        __m128i x = _mm_add_epi16(_mm_loadu_si128((__m128i *)(values + i)),
+            _mm_loadu_si128((__m128i *)(biases + i)));
+        x = _mm_min_epi16(_mm_max_epi16(x, zero), one);
+        sum = _mm_add_epi32(sum, _mm_madd_epi16(x, _mm_loadu_si128((__m128i *)(weights + i))));
+    }
+#endif
+#if defined(__AVX2__) || defined(__SSE2__)
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4e));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xb1));
+    return _mm_cvtsi128_si32(sum);
+#else
+    int32 sum = 0;
+    for (uint32 i = 0; i < NNUE_HIDDEN; i++) {
+        int16 x = values[i] + biases[i];
+        sum += utMin(utMax(x, 0), NNUE_QA)*weights[i];
+    }
+    return sum;
+#endif
+}
+
+// Return the network's score for the side to move.
+static inline int32 findNetworkScore(chBoard board, bool whitesTurn) {
+    chAccumulator *accumulator = getAccumulator(board);
+    int32 sum = network->outputBias +
+        findOutputSum(accumulator->values[whitesTurn], network->featureBiases, network->outputWeights[0]) +
+        findOutputSum(accumulator->values[!whitesTurn], network->featureBiases, network->outputWeights[1]);
+    return (int64)sum*NNUE_SCALE/(NNUE_QA*NNUE_QB);
+}
+
+// Compute the board's accumulator from scratch.
+static void findAccumulator(chBoard board, chAccumulator *accumulator) {
+    memset(accumulator, 0, sizeof(chAccumulator));
+    chBitboards *bitboards = getBitboards(board);
+    for (uint8 white = 0; white < 2; white++) {
+        for (uint8 type = CH_PAWN; type <= CH_KING; type++) {
+            for (uint64 pieces = bitboards->pieces[white][type]; pieces != 0; pieces &= pieces - 1) {
+                uint8 square = firstSquare(pieces);
+                for (uint8 perspective = 0; perspective < 2; perspective++) {
+                    addWeights(accumulator->values[perspective],
+                        network->featureWeights[findFeature(perspective, white, type, square)]);
+                }
+            }
+        }
+    }
+}
+
+// Load a network.  The file holds "CHNN", the hidden layer size as a uint32,
+// then the fields of chNetwork in order, all little-endian.  Boards must be
+// set up after the network is loaded, so their accumulators are kept.
+static void loadNetwork(char *fileName) {
+    FILE *file = fopen(fileName, "rb");
+    if (file == NULL) {
+        utExit("Unable to open network file %s", fileName);
+    }
+    char magic[4];
+    uint32 hidden;
+    if (fread(magic, sizeof(magic), 1, file) != 1 || memcmp(magic, "CHNN", sizeof(magic)) ||
+            fread(&hidden, sizeof(uint32), 1, file) != 1 || hidden != NNUE_HIDDEN) {
+        utExit("%s is not a network with %u hidden units", fileName, NNUE_HIDDEN);
+    }
+    network = malloc(sizeof(chNetwork));
+    if (network == NULL) {
+        utExit("Unable to allocate the network");
+    }
+    if (fread(network->featureWeights, sizeof(network->featureWeights), 1, file) != 1 ||
+            fread(network->featureBiases, sizeof(network->featureBiases), 1, file) != 1 ||
+            fread(network->outputWeights, sizeof(network->outputWeights), 1, file) != 1 ||
+            fread(&network->outputBias, sizeof(int32), 1, file) != 1 || fgetc(file) != EOF) {
+        utExit("Network file %s is the wrong size", fileName);
+    }
+    fclose(file);
+}
+
+// Return the highest numbered square in a non-empty bitboard.
+static inline uint8 lastSquare(uint64 bits) {
+    return 63 - __builtin_clzll(bits);
+}
+
+// Return the squares a slider on square attacks in one direction, up to and
+// including the first occupied square.
+static inline uint64 findRayAttacks(uint64 occupied, uint8 square, uint8 dir) {
+    uint64 attacks = rayAttacks[dir][square];
+    uint64 blockers = attacks & occupied;
+    if (blockers != 0) {
+        uint8 blocker = dir < SOUTH? firstSquare(blockers) : lastSquare(blockers);
+        attacks ^= rayAttacks[dir][blocker];
+    }
+    return attacks;
+}
+
+// Return the squares a rook on square attacks.
+static inline uint64 findRookAttacks(uint64 occupied, uint8 square) {
+    return findRayAttacks(occupied, square, NORTH) | findRayAttacks(occupied, square, EAST) |
+        findRayAttacks(occupied, square, SOUTH) | findRayAttacks(occupied, square, WEST);
+}
+
+// Return the squares a bishop on square attacks.
+static inline uint64 findBishopAttacks(uint64 occupied, uint8 square) {
+    return findRayAttacks(occupied, square, NORTH_EAST) | findRayAttacks(occupied, square, NORTH_WEST) |
+        findRayAttacks(occupied, square, SOUTH_EAST) | findRayAttacks(occupied, square, SOUTH_WEST);
+}
+
+// Return true if any of the sliders, which must be on lines through the
+// square, has nothing in occupied between it and the square.
+static inline bool slidersReach(uint64 sliders, uint8 square, uint64 occupied) {
+    for (; sliders != 0; sliders &= sliders - 1) {
+        if ((betweenSquares[square][firstSquare(sliders)] & occupied) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Return true if the square is attacked by the white or black pieces, when
+// the occupied squares are occupied.
+static inline bool squareAttackedThrough(chBitboards *bitboards, uint8 square, bool byWhite,
+        uint64 occupied) {
+    uint64 *pieces = bitboards->pieces[byWhite];
+    return (pawnAttacks[!byWhite][square] & pieces[CH_PAWN]) ||
+        (knightAttacks[square] & pieces[CH_KNIGHT]) ||
+        (kingAttacks[square] & pieces[CH_KING]) ||
+        slidersReach(rookRays[square] & (pieces[CH_ROOK] | pieces[CH_QUEEN]), square, occupied) ||
+        slidersReach(bishopRays[square] & (pieces[CH_BISHOP] | pieces[CH_QUEEN]), square, occupied);
+}
+
+// Return true if the square is attacked by the white or black pieces.
+static bool squareAttacked(chBitboards *bitboards, uint8 square, bool byWhite) {
+    return squareAttackedThrough(bitboards, square, byWhite, bitboards->occupied);
+}
+
+// Return the pieces of the other side giving check to the side's king on
+// kingSquare.  Set *retPinned to the side's pieces that are the only piece
+// between their king and an enemy slider, and so can only move along that line.
+static inline uint64 findCheckers(chBitboards *bitboards, bool white, uint8 kingSquare, uint64 *retPinned) {
+    uint64 *pieces = bitboards->pieces[!white];
+    uint64 checkers = (pawnAttacks[white][kingSquare] & pieces[CH_PAWN]) |
+        (knightAttacks[kingSquare] & pieces[CH_KNIGHT]);
+    uint64 snipers = (rookRays[kingSquare] & (pieces[CH_ROOK] | pieces[CH_QUEEN])) |
+        (bishopRays[kingSquare] & (pieces[CH_BISHOP] | pieces[CH_QUEEN]));
+    uint64 pinned = 0;
+    for (; snipers != 0; snipers &= snipers - 1) {
+        uint8 sniper = firstSquare(snipers);
+        uint64 blockers = betweenSquares[kingSquare][sniper] & bitboards->occupied;
+        if (blockers == 0) {
+            checkers |= (uint64)1 << sniper;
+        } else if ((blockers & (blockers - 1)) == 0) {
+            pinned |= blockers & bitboards->colors[white];
+        }
+    }
+    *retPinned = pinned;
+    return checkers;
+}
+
+// Return true if the side's king is attacked.
+static bool kingInCheck(chBoard board, bool white) {
+    chPiece king = white? chBoardGetWhiteKing(board) : chBoardGetBlackKing(board);
+    utAssert(pieceInPlay(king));
+    return squareAttacked(getBitboards(board), chPieceGetSquare(king), !white);
+}
+
+// Zobrist keys, filled in by initZobristKeys.  A board's hash is the XOR of
+// the keys for each piece on its square, the castling rights, the en passant
+// file, and whether it is black's turn.
+static uint64 pieceKeys[2][6][ROWS*COLS];  // Indexed by [white][type][square].
+static uint64 castlingKeys[16];
+static uint64 enPassantKeys[COLS];
+static uint64 blackToMoveKey;
+
+// Return a pseudo-random 64-bit number.  Keys do not use rand(), so they do
+// not depend on the game seed.
+static uint64 randomKey(uint64 *state) {
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 2685821657736338717ull;
+}
+
+// Fill in the Zobrist keys.
+static void initZobristKeys(void) {
+    uint64 state = 0x9e3779b97f4a7c15ull;
+    for (uint8 white = 0; white < 2; white++) {
+        for (uint8 type = CH_PAWN; type <= CH_KING; type++) {
+            for (uint8 square = 0; square < ROWS*COLS; square++) {
+                pieceKeys[white][type][square] = randomKey(&state);
+            }
+        }
+    }
+    // No castling rights hashes to 0, so boards start with no castling key.
+    for (uint8 rights = 1; rights < 16; rights++) {
+        castlingKeys[rights] = randomKey(&state);
+    }
+    for (uint8 col = 0; col < COLS; col++) {
+        enPassantKeys[col] = randomKey(&state);
+    }
+    blackToMoveKey = randomKey(&state);
+}
+
+// XOR the piece's key for (row, col) into the board's hash, and into its pawn
+// hash if it is a pawn.
+static inline void hashPiece(chBoard board, chPiece piece, uint8 row, uint8 col) {
+    chPieceType type = getPieceType(piece);
+    uint64 key = pieceKeys[pieceWhite(piece)][type][COLS*row + col];
+    chBoardSetHash(board, chBoardGetHash(board) ^ key);
+    if (type == CH_PAWN) {
+        chBoardSetPawnHash(board, chBoardGetPawnHash(board) ^ key);
+    }
 }
 
 // Return the piece at (row, col).  (0, 0) is bottome left.
 static inline void setPieceAtPosition(chBoard board, uint8 row, uint8 col, chPiece piece) {
     if (piece != chPieceNull) {
         utAssert(getPieceAtPosition(board, row, col) == chPieceNull);
-        chPieceSetRow(piece, row);
-        chPieceSetCol(piece, col);
-        chPieceSetInPlay(piece, true);
-        if (chPieceWhite(piece)) {
+        chPieceSetSquare(piece, COLS*row + col);
+        setPieceFlag(piece, PIECE_IN_PLAY, true);
+        bool white = pieceWhite(piece);
+        uint64 bit = squareBit(row, col);
+        chBitboards *bitboards = getBitboards(board);
+        bitboards->pieces[white][getPieceType(piece)] |= bit;
+        bitboards->colors[white] |= bit;
+        bitboards->occupied |= bit;
+        hashPiece(board, piece, row, col);
+        if (white) {
             chBoardSetWhiteScore(board, chBoardGetWhiteScore(board) + findPieceScore(piece));
         } else {
             chBoardSetBlackScore(board, chBoardGetBlackScore(board) + findPieceScore(piece));
         }
+        chBoardSetPhase(board, chBoardGetPhase(board) + phaseWeights[getPieceType(piece)]);
+        if (network != NULL) {
+            updateAccumulator(board, piece, COLS*row + col, true);
+        }
     }
     chBoardSetiPosition(board, COLS*row + col, piece);
+#if defined(DD_DEBUG)
     verifyScore(board);
+#endif
 }
 
 // Remove a piece and return it.
@@ -91,13 +753,26 @@ static inline chPiece removePieceAtPosition(chBoard board, uint8 row, uint8 col)
     chPiece piece = getPieceAtPosition(board, row, col);
     utAssert(piece != chPieceNull);
     setPieceAtPosition(board, row, col, chPieceNull);
-    chPieceSetInPlay(piece, false);
-    if (chPieceWhite(piece)) {
+    setPieceFlag(piece, PIECE_IN_PLAY, false);
+    bool white = pieceWhite(piece);
+    uint64 bit = squareBit(row, col);
+    chBitboards *bitboards = getBitboards(board);
+    bitboards->pieces[white][getPieceType(piece)] &= ~bit;
+    bitboards->colors[white] &= ~bit;
+    bitboards->occupied &= ~bit;
+    hashPiece(board, piece, row, col);
+    if (white) {
         chBoardSetWhiteScore(board, chBoardGetWhiteScore(board) - findPieceScore(piece));
     } else {
         chBoardSetBlackScore(board, chBoardGetBlackScore(board) - findPieceScore(piece));
     }
+    chBoardSetPhase(board, chBoardGetPhase(board) - phaseWeights[getPieceType(piece)]);
+    if (network != NULL) {
+        updateAccumulator(board, piece, COLS*row + col, false);
+    }
+#if defined(DD_DEBUG)
     verifyScore(board);
+#endif
     return piece;
 }
 
@@ -107,8 +782,8 @@ static inline char getPieceLetter(chBoard board, uint8 row, uint8 col) {
     if (piece == chPieceNull) {
         return (row ^ col) & 1? ' ' : '.';
     }
-    if (chPieceWhite(piece)) {
-        switch (chPieceGetType(piece)) {
+    if (pieceWhite(piece)) {
+        switch (getPieceType(piece)) {
             case CH_PAWN: return 'P';
             case CH_ROOK: return 'R';
             case CH_KNIGHT: return 'H';
@@ -119,7 +794,7 @@ static inline char getPieceLetter(chBoard board, uint8 row, uint8 col) {
                 utExit("Unknown piece type.");
         }
     } else {
-        switch (chPieceGetType(piece)) {
+        switch (getPieceType(piece)) {
             case CH_PAWN: return 'p';
             case CH_ROOK: return 'r';
             case CH_KNIGHT: return 'h';
@@ -165,11 +840,7 @@ static void printBoard(chBoard board) {
 // Create a new piece and place it on the board.
 static chPiece chPieceCreate(chBoard board, chPieceType type, bool white, uint8 row, uint8 col) {
     chPiece piece = chPieceAlloc();
-    chPieceSetType(piece, type);
-    chPieceSetWhite(piece, white);
-    chPieceSetRow(piece, row);
-    chPieceSetCol(piece, col);
-    chPieceSetNeverMoved(piece, true);
+    chPieceSetFlags(piece, type | (white? PIECE_WHITE : 0) | PIECE_NEVER_MOVED);
     chBoardAppendPiece(board, piece);
     setPieceAtPosition(board, row, col, piece);
     return piece;
@@ -206,177 +877,563 @@ static void addPieces(chBoard board) {
     }
 }
 
-// Create a new board, set up to play.
-static chBoard chBoardCreate(bool playerWhite) {
-    chBoard board = chBoardAlloc();
-    chBoardSetPlayerWhite(board, playerWhite);
-    chBoardAllocPositions(board, ROWS*COLS);
-    chBoardAllocMoves(board, 4096);
-    chBoardAllocUndoMoves(board, 4096);
-    addPieces(board);
-    return board;
-}
+// Castling rights, as used to index castlingKeys.
+#define WHITE_KINGSIDE 1
+#define WHITE_QUEENSIDE 2
+#define BLACK_KINGSIDE 4
+#define BLACK_QUEENSIDE 8
 
-// Determine if the game is over.
-static bool gameOver(chBoard board) {
-    return !chPieceInPlay(chBoardGetWhiteKing(board)) ||
-        !chPieceInPlay(chBoardGetBlackKing(board));
-}
+// The squares where a move can change castling rights.
+#define CASTLING_SQUARES (squareBit(0, 0) | squareBit(0, 4) | squareBit(0, 7) | \
+        squareBit(7, 0) | squareBit(7, 4) | squareBit(7, 7))
 
-// Parse a move.
-static bool parseMove(char *text, chMove *move) {
-    if (strlen(text) != 5) {
-        return false;
-    }
-    char fromCol = *text++;
-    char fromRow = *text++;
-    text++;
-    char toCol = *text++;
-    char toRow = *text++;
-    if (fromCol < 'a' || fromCol > 'h' || fromRow < '1' || fromRow > '8' ||
-            toCol < 'a' || toCol > 'h' || toRow < '1' || toRow > '8') {
-        return false;
-    }
-    move->fromRow = fromRow - '1';
-    move->toRow = toRow - '1';
-    move->fromCol = fromCol - 'a';
-    move->toCol = toCol - 'a';
-    return true;
+// Return true if there is a rook at (row, col) which has never moved.
+static inline bool rookNeverMoved(chBoard board, uint8 row, uint8 col) {
+    chPiece rook = getPieceAtPosition(board, row, col);
+    return rook != chPieceNull && getPieceType(rook) == CH_ROOK && pieceNeverMoved(rook);
 }
 
-// Move the fromRow and fromCol square one step closer to the toRow and toCol.
-static inline void stepTowardsDestinationSquare(chMove *move) {
-    if (move->fromCol < move->toCol) {
-        move->fromCol++;
-    } else if (move->fromCol > move->toCol) {
-        move->fromCol--;
+// Return the castling rights for one side, shifted into place.
+static inline uint8 findSideCastlingRights(chBoard board, chPiece king, uint8 row, uint8 shift) {
+    if (!pieceInPlay(king) || !pieceNeverMoved(king)) {
+        return 0;
     }
-    if (move->fromRow < move->toRow) {
-        move->fromRow++;
-    } else if (move->fromRow > move->toRow) {
-        move->fromRow--;
+    uint8 rights = rookNeverMoved(board, row, 7)? WHITE_KINGSIDE : 0;
+    if (rookNeverMoved(board, row, 0)) {
+        rights |= WHITE_QUEENSIDE;
     }
+    return rights << shift;
 }
 
-// Return true if the move moves from a square to itself.
-static inline bool movesToSameSquare(chMove move) {
-    return move.fromRow == move.toRow && move.fromCol == move.toCol;
+// Return the castling rights, derived from which kings and rooks have never moved.
+static inline uint8 findCastlingRights(chBoard board) {
+    return findSideCastlingRights(board, chBoardGetWhiteKing(board), 0, 0) |
+        findSideCastlingRights(board, chBoardGetBlackKing(board), 7, 2);
 }
 
-// Determine if the spaces between the from square and to square are empty.
-static inline bool spacesEmptyBetween(chBoard board, chMove move) {
-    stepTowardsDestinationSquare(&move);
-    while (!movesToSameSquare(move)) {
-        if (!squareEmpty(board, move.fromRow, move.fromCol)) {
-            return false;
+// Compute the board's hash from scratch.
+static uint64 findHash(chBoard board, bool whitesTurn) {
+    uint64 hash = castlingKeys[findCastlingRights(board)];
+    chPiece piece;
+    chForeachBoardPiece(board, piece) {
+        if (pieceInPlay(piece)) {
+            uint8 square = chPieceGetSquare(piece);
+            hash ^= pieceKeys[pieceWhite(piece)][getPieceType(piece)][square];
         }
-        stepTowardsDestinationSquare(&move);
+    } chEndBoardPiece;
+    uint8 enPassantSquare = chBoardGetEnPassantSquare(board);
+    if (enPassantSquare != 0) {
+        hash ^= enPassantKeys[enPassantSquare % COLS];
     }
-    return true;
-}
-
-// Return the absolute value of an int8.
-static inline int8 abs8(int8 val) {
-    return val >= 0? val : -val;
+    return whitesTurn? hash : hash ^ blackToMoveKey;
 }
 
-// Check special rules for castling.
-static inline bool castling(chPiece king, chMove move) {
-    return chPieceGetType(king) == CH_KING && abs8(move.fromCol - move.toCol) >= 2;
+// Compute the board's pawn hash from scratch: the XOR of the pawns' keys.
+static uint64 findPawnHash(chBoard board) {
+    uint64 hash = 0;
+    chBitboards *bitboards = getBitboards(board);
+    for (uint8 white = 0; white < 2; white++) {
+        for (uint64 pawns = bitboards->pieces[white][CH_PAWN]; pawns != 0; pawns &= pawns - 1) {
+            hash ^= pieceKeys[white][CH_PAWN][firstSquare(pawns)];
+        }
+    }
+    return hash;
 }
 
-// Determine if the pawn move is legal.
-static inline bool pawnMoveLegal(chBoard board, chPiece piece, chMove move, chPiece target) {
-    //TODO: check for special case of taking a pawn that just moved two spaces.
-    if (target == chPieceNull) {
-        // Can only move straight.
-        if (move.fromCol != move.toCol) {
-            return false;
-        }
-        if (chPieceWhite(piece)) {
-            if (move.fromRow  + 1 == move.toRow) {
-                return true;
+// Check that the whole board state is consistent: the positions and the
+// pieces' rows and columns, the scores, the kings, the bitboards, the hash and
+// the move and undo stacks.  This is too slow to do on every move, so the
+// search only calls it every searchAuditInterval moves.
+static void auditBoard(chBoard board, bool whitesTurn) {
+    chBitboards bitboards;
+    memset(&bitboards, 0, sizeof(chBitboards));
+    for (uint8 row = 0; row < ROWS; row++) {
+        for (uint8 col = 0; col < COLS; col++) {
+            chPiece piece = getPieceAtPosition(board, row, col);
+            if (piece != chPieceNull) {
+                utAssert(pieceInPlay(piece) && getPieceRow(piece) == row && getPieceCol(piece) == col);
+                uint64 bit = squareBit(row, col);
+                bool white = pieceWhite(piece);
+                bitboards.pieces[white][getPieceType(piece)] |= bit;
+                bitboards.colors[white] |= bit;
+                bitboards.occupied |= bit;
             }
-            return move.fromRow == 1 && move.toRow == 3 && squareEmpty(board, 2, move.fromCol);
         }
-        if (move.fromRow == move.toRow + 1) {
-            return true;
+    }
+    utAssert(!memcmp(&bitboards, getBitboards(board), sizeof(chBitboards)));
+    chPiece piece;
+    chForeachBoardPiece(board, piece) {
+        if (pieceInPlay(piece)) {
+            utAssert(getPieceAtPosition(board, getPieceRow(piece), getPieceCol(piece)) == piece);
         }
-        return move.fromRow == 6 && move.toRow == 4 && squareEmpty(board, 5, move.fromCol);
+    } chEndBoardPiece;
+    verifyScore(board);
+    chPiece whiteKing = chBoardGetWhiteKing(board);
+    chPiece blackKing = chBoardGetBlackKing(board);
+    utAssert(getPieceType(whiteKing) == CH_KING && pieceWhite(whiteKing));
+    utAssert(getPieceType(blackKing) == CH_KING && !pieceWhite(blackKing));
+    // Only legal moves are made, so kings are never taken.
+    utAssert(pieceInPlay(whiteKing) && __builtin_popcountll(bitboards.pieces[true][CH_KING]) == 1);
+    utAssert(pieceInPlay(blackKing) && __builtin_popcountll(bitboards.pieces[false][CH_KING]) == 1);
+    uint8 enPassantSquare = chBoardGetEnPassantSquare(board);
+    utAssert(enPassantSquare == 0 || enPassantSquare / COLS == (whitesTurn? ROWS - 3 : 2));
+    utAssert(chBoardGetHash(board) == findHash(board, whitesTurn));
+    utAssert(chBoardGetPawnHash(board) == findPawnHash(board));
+    if (network != NULL) {
+        chAccumulator accumulator;
+        findAccumulator(board, &accumulator);
+        utAssert(!memcmp(&accumulator, getAccumulator(board), sizeof(chAccumulator)));
     }
-    // Taking a piece.  Must move diagonally upward by 1.
-    if (move.fromCol != move.toCol + 1 && move.fromCol + 1 != move.toCol) {
-        return false;
+    uint32 undoMovePos = chBoardGetUndoMovePos(board);
+    utAssert(undoMovePos <= chBoardGetNumUndoMove(board));
+    // The game record is the bottom of the undo stack.
+    utAssert(chBoardGetNumMove(board) <= undoMovePos);
+    for (uint32 i = 0; i < chBoardGetNumMove(board); i++) {
+        utAssert(chBoardGetiMove(board, i) == chBoardGetiUndoMove(board, i).move);
     }
-    if (chPieceWhite(piece)) {
-        return move.fromRow + 1 == move.toRow;
+    for (uint32 i = 0; i < undoMovePos; i++) {
+        chUndoMove undoMove = chBoardGetiUndoMove(board, i);
+        chMove move = undoMove.move;
+        uint16 flags = move & MOVE_FLAGS;
+        // Null moves, from null-move pruning, pass the turn without moving.
+        utAssert(move == NULL_MOVE || moveFrom(move) != moveTo(move));
+        utAssert(flags == 0 || flags == MOVE_CASTLE || flags == MOVE_EN_PASSANT ||
+            (flags & MOVE_PROMOTION && movePromotionType(move) >= CH_ROOK && movePromotionType(move) <= CH_QUEEN));
+        utAssert(undoMove.target == chPieceNull || !pieceInPlay(undoMove.target));
     }
-    return move.fromRow == move.toRow + 1;
 }
 
-// Determine if the pawn move is legal.
-static inline bool rookMoveLegal(chBoard board, chPiece piece, chMove move, chPiece target) {
-    if (move.fromRow != move.toRow && move.fromCol != move.toCol) {
-        return false;
-    }
-    return spacesEmptyBetween(board, move);
+// Create a new board with no pieces.  Its move array is the game record,
+// which starts empty.
+static chBoard chBoardCreateEmpty(bool playerWhite) {
+    chBoard board = chBoardAlloc();
+    chBoardSetPlayerWhite(board, playerWhite);
+    chBoardAllocPositions(board, ROWS*COLS);
+    chBoardAllocUndoMoves(board, MAX_GAME_MOVES);
+    return board;
 }
 
-// Determine if the pawn move is legal.
-static inline bool knightMoveLegal(chPiece piece, chMove move, chPiece target) {
-    uint8 rowDist = abs8(move.toRow - move.fromRow);
-    uint8 colDist = abs8(move.toCol - move.fromCol);
-    return (rowDist == 1 && colDist == 2) || (rowDist == 2 && colDist == 1);
+// Create a new board, set up to play.
+static chBoard chBoardCreate(bool playerWhite) {
+    chBoard board = chBoardCreateEmpty(playerWhite);
+    addPieces(board);
+    chBoardSetHash(board, findHash(board, true));
+    return board;
 }
 
-// Determine if the pawn move is legal.
-static inline bool bishopMoveLegal(chBoard board, chPiece piece, chMove move, chPiece target) {
-    if (move.fromRow - move.fromCol != move.toRow - move.toCol &&
-            move.fromRow + move.fromCol != move.toRow + move.toCol) {
-        return false;
+// Remove all the pieces from the board, keeping them in its piece list so
+// they can be reused.
+static void clearBoard(chBoard board) {
+    for (uint8 square = 0; square < ROWS*COLS; square++) {
+        chBoardSetiPosition(board, square, chPieceNull);
     }
-    return spacesEmptyBetween(board, move);
+    memset(getBitboards(board), 0, sizeof(chBitboards));
+    memset(getAccumulator(board), 0, sizeof(chAccumulator));
+    chBoardSetWhiteScore(board, 0);
+    chBoardSetBlackScore(board, 0);
+    chBoardSetPhase(board, 0);
+    chBoardSetHalfMoveClock(board, 0);
+    chBoardSetPawnHash(board, 0);
+    chPiece piece;
+    chForeachBoardPiece(board, piece) {
+        setPieceFlag(piece, PIECE_IN_PLAY, false);
+    } chEndBoardPiece;
 }
 
-// Determine if the pawn move is legal.
-static inline bool queenMoveLegal(chBoard board, chPiece piece, chMove move, chPiece target) {
-    if (move.fromRow != move.toRow && move.fromCol != move.toCol &&
-            move.fromRow - move.fromCol != move.toRow - move.toCol &&
-            move.fromRow + move.fromCol != move.toRow + move.toCol) {
-        return false;
+// Copy the position on src to dest, reusing dest's pieces, and allocating
+// more if needed.  The game record is not copied.
+static void copyBoard(chBoard dest, chBoard src) {
+    clearBoard(dest);
+    chPiece destPiece = chBoardGetFirstPiece(dest);
+    chPiece srcPiece;
+    chForeachBoardPiece(src, srcPiece) {
+        if (destPiece == chPieceNull) {
+            destPiece = chPieceAlloc();
+            chBoardAppendPiece(dest, destPiece);
+        }
+        chPieceSetFlags(destPiece, chPieceGetFlags(srcPiece) & ~PIECE_IN_PLAY);
+        if (pieceInPlay(srcPiece)) {
+            setPieceAtPosition(dest, getPieceRow(srcPiece), getPieceCol(srcPiece), destPiece);
+        }
+        if (srcPiece == chBoardGetWhiteKing(src)) {
+            chBoardSetWhiteKing(dest, destPiece);
+        } else if (srcPiece == chBoardGetBlackKing(src)) {
+            chBoardSetBlackKing(dest, destPiece);
+        }
+        destPiece = chPieceGetNextBoardPiece(destPiece);
+    } chEndBoardPiece;
+    chBoardSetEnPassantSquare(dest, chBoardGetEnPassantSquare(src));
+    chBoardSetHalfMoveClock(dest, chBoardGetHalfMoveClock(src));
+    chBoardSetHash(dest, chBoardGetHash(src));
+    // Copy the undo moves back to the last capture or pawn move, so the copy
+    // sees repetitions too.  They refer to src's pieces, and are never undone.
+    uint32 numUndoMoves = utMin(chBoardGetHalfMoveClock(src), chBoardGetUndoMovePos(src));
+    if (chBoardGetNumUndoMove(dest) < numUndoMoves + MAX_SEARCH_DEPTH) {
+        chBoardResizeUndoMoves(dest, numUndoMoves + MAX_SEARCH_DEPTH);
     }
-    return spacesEmptyBetween(board, move);
+    chBoardCopyUndoMoves(dest, 0, chBoardGetUndoMoves(src) + chBoardGetUndoMovePos(src) - numUndoMoves,
+        numUndoMoves);
+    chBoardSetUndoMovePos(dest, numUndoMoves);
 }
 
-// Determine if the pawn move is legal.
-static inline bool kingMoveLegal(chBoard board, chPiece piece, chMove move, chPiece target) {
-    // TODO: Check for moving into check.
-    uint8 rowDist = abs8(move.toRow - move.fromRow);
-    uint8 colDist = abs8(move.toCol - move.fromCol);
-    if (rowDist <= 1 && colDist <= 1) {
-        return true;
+// FEN piece letters, indexed by piece type.
+static const char fenPieceChars[] = "prnbqk";
+
+// Set up the board from a FEN string, reusing its pieces, and set
+// *retWhitesTurn to the side to move.  Castling rights become the neverMoved
+// flags of the kings and rooks, and pawns on their first row have never moved.
+// The move counters are optional: the half-move clock is read, and the
+// full-move number is ignored.  Return false if the FEN is not valid, in which
+// case the board must be loaded again before it is used.
+static bool loadFen(chBoard board, char *fen, bool *retWhitesTurn) {
+    clearBoard(board);
+    chBoardSetWhiteKing(board, chPieceNull);
+    chBoardSetBlackKing(board, chPieceNull);
+    chPiece piece = chBoardGetFirstPiece(board);
+    int8 row = ROWS - 1;
+    uint8 col = 0;
+    for (; *fen != ' ' && *fen != '\0'; fen++) {
+        char c = *fen;
+        if (c == '/') {
+            if (col != COLS || --row < 0) {
+                return false;
+            }
+            col = 0;
+        } else if (c >= '1' && c <= '8') {
+            col += c - '0';
+            if (col > COLS) {
+                return false;
+            }
+        } else {
+            char *p = strchr(fenPieceChars, c | 0x20);
+            if (p == NULL || col >= COLS) {
+                return false;
+            }
+            if (piece == chPieceNull) {
+                piece = chPieceAlloc();
+                chBoardAppendPiece(board, piece);
+            }
+            chPieceType type = p - fenPieceChars;
+            bool white = c < 'a';
+            bool neverMoved = type == CH_PAWN && row == (white? 1 : ROWS - 2);
+            chPieceSetFlags(piece, type | (white? PIECE_WHITE : 0) | (neverMoved? PIECE_NEVER_MOVED : 0));
+            setPieceAtPosition(board, row, col, piece);
+            if (type == CH_KING) {
+                if (white? chBoardGetWhiteKing(board) != chPieceNull : chBoardGetBlackKing(board) != chPieceNull) {
+                    return false;
+                }
+                if (white) {
+                    chBoardSetWhiteKing(board, piece);
+                } else {
+                    chBoardSetBlackKing(board, piece);
+                }
+            }
+            piece = chPieceGetNextBoardPiece(piece);
+            col++;
+        }
     }
-    // Check for castling.
-    if (!chPieceNeverMoved(piece) || move.fromRow != move.toRow || !spacesEmptyBetween(board, move) ||
-            (move.fromRow != 0 && move.fromRow != 7)) {
+    if (row != 0 || col != COLS || chBoardGetWhiteKing(board) == chPieceNull ||
+            chBoardGetBlackKing(board) == chPieceNull || *fen++ != ' ') {
         return false;
     }
-    // TODO: check that the king is not in check or moving through check.
-    chPiece rook;
-    if (move.toCol == 6) {
-        rook = getPieceAtPosition(board, move.fromRow, 7);
-    } else if (move.toCol == 2) {
-        rook = getPieceAtPosition(board, move.fromRow, 0);
+    if (*fen != 'w' && *fen != 'b') {
+        return false;
+    }
+    bool whitesTurn = *fen++ == 'w';
+    if (*fen++ != ' ') {
+        return false;
+    }
+    if (*fen == '-') {
+        fen++;
+    }
+    for (; *fen != ' ' && *fen != '\0'; fen++) {
+        char *p = strchr("KQkq", *fen);
+        if (p == NULL) {
+            return false;
+        }
+        bool white = p - "KQkq" < 2;
+        uint8 rookRow = white? 0 : ROWS - 1;
+        chPiece king = white? chBoardGetWhiteKing(board) : chBoardGetBlackKing(board);
+        chPiece rook = getPieceAtPosition(board, rookRow, *fen == 'K' || *fen == 'k'? COLS - 1 : 0);
+        // Ignore rights that the pieces on the board cannot have.
+        if (getPieceRow(king) == rookRow && getPieceCol(king) == 4 && rook != chPieceNull &&
+                getPieceType(rook) == CH_ROOK && pieceWhite(rook) == white) {
+            setPieceFlag(king, PIECE_NEVER_MOVED, true);
+            setPieceFlag(rook, PIECE_NEVER_MOVED, true);
+        }
+    }
+    // Reject positions no game can reach: a pawn on the first or last row, or
+    // the side that just moved left in check.
+    chBitboards *bitboards = getBitboards(board);
+    uint64 pawns = bitboards->pieces[true][CH_PAWN] | bitboards->pieces[false][CH_PAWN];
+    if ((pawns & ((uint64)0xff | (uint64)0xff << COLS*(ROWS - 1))) != 0 || kingInCheck(board, !whitesTurn)) {
+        return false;
+    }
+    uint8 enPassantSquare = 0;
+    if (*fen == ' ' && fen[1] != '-' && fen[1] != '\0') {
+        fen++;
+        if (fen[0] < 'a' || fen[0] > 'h' || fen[1] != (whitesTurn? '6' : '3')) {
+            return false;
+        }
+        uint8 square = COLS*(fen[1] - '1') + fen[0] - 'a';
+        // The other side's pawn must have just moved two squares, past this one.
+        uint8 pawnSquare = whitesTurn? square - COLS : square + COLS;
+        uint8 startSquare = whitesTurn? square + COLS : square - COLS;
+        if ((bitboards->pieces[!whitesTurn][CH_PAWN] & ((uint64)1 << pawnSquare)) == 0 ||
+                (bitboards->occupied & (((uint64)1 << square) | ((uint64)1 << startSquare))) != 0) {
+            return false;
+        }
+        // Like makeMove, only keep the square if a pawn can capture there.
+        if (pawnAttacks[!whitesTurn][square] & bitboards->pieces[whitesTurn][CH_PAWN]) {
+            enPassantSquare = square;
+        }
+    }
+    chBoardSetEnPassantSquare(board, enPassantSquare);
+    // The half-move clock follows the en passant square, if given.
+    char *clock = strchr(fen + (*fen == ' '), ' ');
+    chBoardSetHalfMoveClock(board, clock != NULL? utMin(strtoul(clock + 1, NULL, 10), UINT16_MAX) : 0);
+    chBoardSetHash(board, findHash(board, whitesTurn));
+    chBoardResizeMoves(board, 0);
+    chBoardSetUndoMovePos(board, 0);
+    *retWhitesTurn = whitesTurn;
+    return true;
+}
+
+// Write the board as a FEN string into fen, which must hold MAX_FEN_LENGTH
+// characters.  The half-move clock is written, but the board does not keep
+// the full-move number, so it is always written as 1.
+static void saveFen(chBoard board, bool whitesTurn, char *fen) {
+    for (int8 row = ROWS - 1; row >= 0; row--) {
+        uint8 empty = 0;
+        for (uint8 col = 0; col < COLS; col++) {
+            chPiece piece = getPieceAtPosition(board, row, col);
+            if (piece == chPieceNull) {
+                empty++;
+            } else {
+                if (empty != 0) {
+                    *fen++ = '0' + empty;
+                    empty = 0;
+                }
+                char c = fenPieceChars[getPieceType(piece)];
+                *fen++ = pieceWhite(piece)? c - 0x20 : c;
+            }
+        }
+        if (empty != 0) {
+            *fen++ = '0' + empty;
+        }
+        if (row != 0) {
+            *fen++ = '/';
+        }
+    }
+    *fen++ = ' ';
+    *fen++ = whitesTurn? 'w' : 'b';
+    *fen++ = ' ';
+    uint8 rights = findCastlingRights(board);
+    if (rights == 0) {
+        *fen++ = '-';
+    }
+    for (uint8 i = 0; i < 4; i++) {
+        if (rights & (1 << i)) {
+            *fen++ = "KQkq"[i];
+        }
+    }
+    *fen++ = ' ';
+    uint8 enPassantSquare = chBoardGetEnPassantSquare(board);
+    if (enPassantSquare != 0) {
+        *fen++ = 'a' + enPassantSquare % COLS;
+        *fen++ = '1' + enPassantSquare / COLS;
+    } else {
+        *fen++ = '-';
+    }
+    sprintf(fen, " %u 1", chBoardGetHalfMoveClock(board));
+}
+
+// Return the absolute value of an int8.
+static inline int8 abs8(int8 val) {
+    return val >= 0? val : -val;
+}
+
+// Return the flags a move from square from to square to needs: castling if a
+// king moves two columns, en passant if a pawn moves diagonally to the en
+// passant square, and promotion to promotionType if a pawn reaches the last
+// row.
+static uint16 findMoveFlags(chBoard board, chPiece piece, uint8 from, uint8 to, chPieceType promotionType) {
+    uint8 toRow = to / COLS;
+    if (getPieceType(piece) == CH_KING && abs8(to % COLS - from % COLS) == 2) {
+        return MOVE_CASTLE;
+    }
+    if (getPieceType(piece) != CH_PAWN) {
+        return 0;
+    }
+    if (toRow == 0 || toRow == ROWS - 1) {
+        return promotionFlags(promotionType);
+    }
+    if (from % COLS != to % COLS && to == chBoardGetEnPassantSquare(board) && to != 0 &&
+            squareEmpty(board, toRow, to % COLS)) {
+        return MOVE_EN_PASSANT;
+    }
+    return 0;
+}
+
+// Parse a move like "e2 e4", or "e7 e8n" to promote to a piece other than a
+// queen.  The board is needed to set the move's flags.
+static bool parseMove(chBoard board, char *text, chMove *move) {
+    size_t length = strlen(text);
+    if (length != 5 && length != 6) {
+        return false;
+    }
+    char fromCol = *text++;
+    char fromRow = *text++;
+    text++;
+    char toCol = *text++;
+    char toRow = *text++;
+    if (fromCol < 'a' || fromCol > 'h' || fromRow < '1' || fromRow > '8' ||
+            toCol < 'a' || toCol > 'h' || toRow < '1' || toRow > '8') {
+        return false;
+    }
+    chPieceType promotionType = CH_QUEEN;
+    if (length == 6) {
+        char *p = strchr("rnbq", *text);
+        if (*text == '\0' || p == NULL) {
+            return false;
+        }
+        promotionType = CH_ROOK + (p - "rnbq");
+    }
+    uint8 from = COLS*(fromRow - '1') + fromCol - 'a';
+    uint8 to = COLS*(toRow - '1') + toCol - 'a';
+    chPiece piece = getPieceAtPosition(board, from / COLS, from % COLS);
+    uint16 flags = piece == chPieceNull? 0 : findMoveFlags(board, piece, from, to, promotionType);
+    if (length == 6 && !(flags & MOVE_PROMOTION)) {
+        return false;
+    }
+    *move = encodeMove(from, to, flags);
+    return true;
+}
+
+// Write the move in the form parseMove reads into text, which must hold
+// MAX_MOVE_TEXT characters.
+static void writeMove(chMove move, char *text) {
+    *text++ = 'a' + moveFromCol(move);
+    *text++ = '1' + moveFromRow(move);
+    *text++ = ' ';
+    *text++ = 'a' + moveToCol(move);
+    *text++ = '1' + moveToRow(move);
+    if ((move & MOVE_PROMOTION) && movePromotionType(move) != CH_QUEEN) {
+        *text++ = "prnbqk"[movePromotionType(move)];
+    }
+    *text = '\0';
+}
+
+// Determine if the spaces between the from square and to square are empty.
+static inline bool spacesEmptyBetween(chBoard board, chMove move) {
+    int8 row = moveFromRow(move);
+    int8 col = moveFromCol(move);
+    int8 toRow = moveToRow(move);
+    int8 toCol = moveToCol(move);
+    int8 rowStep = row < toRow? 1 : row > toRow? -1 : 0;
+    int8 colStep = col < toCol? 1 : col > toCol? -1 : 0;
+    row += rowStep;
+    col += colStep;
+    while (row != toRow || col != toCol) {
+        if (!squareEmpty(board, row, col)) {
+            return false;
+        }
+        row += rowStep;
+        col += colStep;
+    }
+    return true;
+}
+
+// Determine if the pawn move is legal.
+static inline bool pawnMoveLegal(chBoard board, chPiece piece, chMove move, chPiece target) {
+    uint8 fromRow = moveFromRow(move);
+    uint8 fromCol = moveFromCol(move);
+    uint8 toRow = moveToRow(move);
+    uint8 toCol = moveToCol(move);
+    if (target == chPieceNull && (move & MOVE_FLAGS) != MOVE_EN_PASSANT) {
+        // Can only move straight.
+        if (fromCol != toCol) {
+            return false;
+        }
+        if (pieceWhite(piece)) {
+            if (fromRow  + 1 == toRow) {
+                return true;
+            }
+            return fromRow == 1 && toRow == 3 && squareEmpty(board, 2, fromCol);
+        }
+        if (fromRow == toRow + 1) {
+            return true;
+        }
+        return fromRow == 6 && toRow == 4 && squareEmpty(board, 5, fromCol);
+    }
+    // Taking a piece, or a pawn en passant.  Must move diagonally upward by 1.
+    if (fromCol != toCol + 1 && fromCol + 1 != toCol) {
+        return false;
+    }
+    if (pieceWhite(piece)) {
+        return fromRow + 1 == toRow;
+    }
+    return fromRow == toRow + 1;
+}
+
+// Determine if the pawn move is legal.
+static inline bool rookMoveLegal(chBoard board, chPiece piece, chMove move, chPiece target) {
+    if (moveFromRow(move) != moveToRow(move) && moveFromCol(move) != moveToCol(move)) {
+        return false;
+    }
+    return spacesEmptyBetween(board, move);
+}
+
+// Determine if the pawn move is legal.
+static inline bool knightMoveLegal(chPiece piece, chMove move, chPiece target) {
+    uint8 rowDist = abs8(moveToRow(move) - moveFromRow(move));
+    uint8 colDist = abs8(moveToCol(move) - moveFromCol(move));
+    return (rowDist == 1 && colDist == 2) || (rowDist == 2 && colDist == 1);
+}
+
+// Determine if the pawn move is legal.
+static inline bool bishopMoveLegal(chBoard board, chPiece piece, chMove move, chPiece target) {
+    if (moveFromRow(move) - moveFromCol(move) != moveToRow(move) - moveToCol(move) &&
+            moveFromRow(move) + moveFromCol(move) != moveToRow(move) + moveToCol(move)) {
+        return false;
+    }
+    return spacesEmptyBetween(board, move);
+}
+
+// Determine if the pawn move is legal.
+static inline bool queenMoveLegal(chBoard board, chPiece piece, chMove move, chPiece target) {
+    return rookMoveLegal(board, piece, move, target) || bishopMoveLegal(board, piece, move, target);
+}
+
+// Determine if the king move is legal, other than moving into check, which
+// kingSafeAfterMove checks.
+static inline bool kingMoveLegal(chBoard board, chPiece piece, chMove move, chPiece target) {
+    uint8 fromRow = moveFromRow(move);
+    uint8 rowDist = abs8(moveToRow(move) - fromRow);
+    uint8 colDist = abs8(moveToCol(move) - moveFromCol(move));
+    if (rowDist <= 1 && colDist <= 1) {
+        return true;
+    }
+    // Check for castling.  Every square between the king and rook must be empty.
+    if (!pieceNeverMoved(piece) || rowDist != 0 || target != chPieceNull ||
+            !spacesEmptyBetween(board, move) || (fromRow != 0 && fromRow != 7)) {
+        return false;
+    }
+    chPiece rook;
+    if (moveToCol(move) == 6) {
+        rook = getPieceAtPosition(board, fromRow, 7);
+    } else if (moveToCol(move) == 2 && squareEmpty(board, fromRow, 1)) {
+        rook = getPieceAtPosition(board, fromRow, 0);
     } else {
         return false;
     }
-    return chPieceNeverMoved(rook);
+    return rook != chPieceNull && pieceNeverMoved(rook);
 }
 
 
 // Determine if the piece is normally allowed to make moves like this.
 static bool pieceCanMakeMove(chBoard board, chPiece piece, chMove move, chPiece target) {
-    switch (chPieceGetType(piece)) {
+    switch (getPieceType(piece)) {
         case CH_PAWN: return pawnMoveLegal(board, piece, move, target);
         case CH_ROOK: return rookMoveLegal(board, piece, move, target);
         case CH_KNIGHT: return knightMoveLegal(piece, move, target);
@@ -389,29 +1446,102 @@ static bool pieceCanMakeMove(chBoard board, chPiece piece, chMove move, chPiece
     return false;  // Dummy return.
 }
 
-// Determine if the move is valid.
+// Return true if the move, which must otherwise be valid, does not leave the
+// mover's king attacked.  Castling must also not start in or pass through
+// check.  The move is played out on a copy of the bitboards, which is all
+// squareAttacked looks at.
+static bool kingSafeAfterMove(chBoard board, chMove move, bool white) {
+    chBitboards bitboards = *getBitboards(board);
+    uint8 from = moveFrom(move);
+    uint8 to = moveTo(move);
+    uint16 flags = move & MOVE_FLAGS;
+    if (flags == MOVE_CASTLE) {
+        return !squareAttacked(&bitboards, from, !white) &&
+            !squareAttacked(&bitboards, (from + to)/2, !white) && !squareAttacked(&bitboards, to, !white);
+    }
+    uint8 captureSquare = flags == MOVE_EN_PASSANT? (white? to - COLS : to + COLS) : to;
+    chPiece target = chBoardGetiPosition(board, captureSquare);
+    if (target != chPieceNull) {
+        uint64 captureBit = (uint64)1 << captureSquare;
+        bitboards.pieces[!white][getPieceType(target)] &= ~captureBit;
+        bitboards.occupied &= ~captureBit;
+    }
+    bitboards.occupied = (bitboards.occupied & ~((uint64)1 << from)) | (uint64)1 << to;
+    chPiece king = white? chBoardGetWhiteKing(board) : chBoardGetBlackKing(board);
+    uint8 kingSquare = chPieceGetSquare(king) == from? to : chPieceGetSquare(king);
+    return !squareAttacked(&bitboards, kingSquare, !white);
+}
+
+// Return true if the quiet move, which must be legal, attacks the enemy king,
+// directly or by uncovering a slider.  Castling counts as giving check, since
+// the rook can give it.  Like kingSafeAfterMove, this plays the move out on a
+// copy of the bitboards.
+static bool quietMoveGivesCheck(chBoard board, chMove move, bool white) {
+    if ((move & MOVE_FLAGS) == MOVE_CASTLE) {
+        return true;
+    }
+    chBitboards bitboards = *getBitboards(board);
+    uint8 from = moveFrom(move);
+    uint64 fromBit = (uint64)1 << from;
+    uint64 toBit = (uint64)1 << moveTo(move);
+    chPieceType type = getPieceType(chBoardGetiPosition(board, from));
+    bitboards.pieces[white][type] &= ~fromBit;
+    if (move & MOVE_PROMOTION) {
+        type = movePromotionType(move);
+    }
+    bitboards.pieces[white][type] |= toBit;
+    bitboards.occupied = (bitboards.occupied & ~fromBit) | toBit;
+    chPiece king = white? chBoardGetBlackKing(board) : chBoardGetWhiteKing(board);
+    return squareAttacked(&bitboards, chPieceGetSquare(king), white);
+}
+
+// Determine if the move is valid, including its flags.  It may still leave
+// the mover's king in check.
 static bool moveValid(chBoard board, chMove move, bool whitesMove) {
-    if (movesToSameSquare(move)) {
+    uint8 from = moveFrom(move);
+    uint8 to = moveTo(move);
+    if (from == to) {
         return false;
     }
-    chPiece piece = getPieceAtPosition(board, move.fromRow, move.fromCol);
-    if (piece == chPieceNull || chPieceWhite(piece) != whitesMove) {
+    chPiece piece = getPieceAtPosition(board, from / COLS, from % COLS);
+    if (piece == chPieceNull || pieceWhite(piece) != whitesMove) {
         return false;
     }
-    chPiece target = getPieceAtPosition(board, move.toRow, move.toCol);
-    if (target != chPieceNull && chPieceWhite(target) == chPieceWhite(piece)) {
+    chPiece target = getPieceAtPosition(board, to / COLS, to % COLS);
+    if (target != chPieceNull && pieceWhite(target) == pieceWhite(piece)) {
+        return false;
+    }
+    chPieceType promotionType = move & MOVE_PROMOTION? movePromotionType(move) : CH_QUEEN;
+    if (promotionType < CH_ROOK || promotionType > CH_QUEEN ||
+            (move & MOVE_FLAGS) != findMoveFlags(board, piece, from, to, promotionType)) {
         return false;
     }
     return pieceCanMakeMove(board, piece, move, target);
 }
 
+// Determine if the move is valid and does not leave the mover's king in check.
+static bool moveLegal(chBoard board, chMove move, bool whitesMove) {
+    return moveValid(board, move, whitesMove) && kingSafeAfterMove(board, move, whitesMove);
+}
+
 // Prompt the user for a move.  If the player types 'u', set undo instead.
 static chMove readPlayerMove(chBoard board, bool whitesMove, bool *undo) {
     char *response = readline("Enter a valid move like d2 d4: ");
-    chMove move = {0, 0, 0, 0};
+    chMove move = NULL_MOVE;
     *undo = false;
-    while (*response != 'u' && (!parseMove(response, &move) || !moveValid(board, move, whitesMove))) {
-        response = readline("Invalid move.  Enter a valid move like d2 d4: ");
+    while (*response != 'u' && (!parseMove(board, response, &move) || !moveLegal(board, move, whitesMove))) {
+        if (!strcmp(response, "audit")) {
+            auditBoard(board, whitesMove);
+            printf("The board is consistent.\n");
+            response = readline("Enter a valid move like d2 d4: ");
+        } else if (!strcmp(response, "fen")) {
+            char fen[MAX_FEN_LENGTH];
+            saveFen(board, whitesMove, fen);
+            printf("%s\n", fen);
+            response = readline("Enter a valid move like d2 d4: ");
+        } else {
+            response = readline("Invalid move.  Enter a valid move like d2 d4: ");
+        }
     }
     if (*response == 'u') {
         *undo = true;
@@ -421,65 +1551,89 @@ static chMove readPlayerMove(chBoard board, bool whitesMove, bool *undo) {
 
 // Finish castling by moving the rook past the king.
 static inline void finishCastling(chBoard board, chMove move) {
-    chPiece rook = chPieceNull;
-    if (move.toCol == 6) {
-        rook = getPieceAtPosition(board, move.fromRow, 7);
-    } else if (move.toCol == 2) {
-        rook = getPieceAtPosition(board, move.fromRow, 0);
-    } else {
-        utExit("Illegal castling");
-    }
-    utAssert(rook != chPieceNull && chPieceGetType(rook) == CH_ROOK && chPieceNeverMoved(rook));
-    removePieceAtPosition(board, chPieceGetRow(rook), chPieceGetCol(rook));
-    if (move.toCol == 6) {
-        setPieceAtPosition(board, move.toRow, 5, rook);
-    } else {
-        setPieceAtPosition(board, move.toRow, 3, rook);
-    }
-    chPieceSetNeverMoved(rook, false);
+    uint8 row = moveFromRow(move);
+    chPiece rook = getPieceAtPosition(board, row, moveToCol(move) == 6? 7 : 0);
+    utAssert(rook != chPieceNull && getPieceType(rook) == CH_ROOK && pieceNeverMoved(rook));
+    removePieceAtPosition(board, getPieceRow(rook), getPieceCol(rook));
+    setPieceAtPosition(board, row, moveToCol(move) == 6? 5 : 3, rook);
+    setPieceFlag(rook, PIECE_NEVER_MOVED, false);
 }
 
 // Undo castling.
 static inline void finishUndoCastling(chBoard board, chMove move) {
-    chPiece rook;
-    uint8 origCol;
-    if (move.toCol == 6) {
-        rook = getPieceAtPosition(board, move.fromRow, 5);
-        origCol = 7;
-    } else {
-        rook = getPieceAtPosition(board, move.fromRow, 3);
-        origCol = 0;
+    uint8 row = moveFromRow(move);
+    chPiece rook = getPieceAtPosition(board, row, moveToCol(move) == 6? 5 : 3);
+    utAssert(rook != chPieceNull && getPieceType(rook) == CH_ROOK && !pieceNeverMoved(rook));
+    removePieceAtPosition(board, row, getPieceCol(rook));
+    setPieceAtPosition(board, row, moveToCol(move) == 6? 7 : 0, rook);
+    setPieceFlag(rook, PIECE_NEVER_MOVED, true);
+}
+
+// Set the en passant square if a pawn just moved two squares, and an enemy
+// pawn is in position to take it.  Update the hash to match.
+static inline void updateEnPassantSquare(chBoard board, chPiece piece, chMove move) {
+    uint64 hash = chBoardGetHash(board);
+    uint8 oldSquare = chBoardGetEnPassantSquare(board);
+    if (oldSquare != 0) {
+        hash ^= enPassantKeys[oldSquare % COLS];
+    }
+    uint8 newSquare = 0;
+    uint8 from = moveFrom(move);
+    uint8 to = moveTo(move);
+    if (getPieceType(piece) == CH_PAWN && abs8(to - from) == 2*COLS) {
+        bool white = pieceWhite(piece);
+        uint8 square = (from + to) >> 1;
+        if (pawnAttacks[white][square] & getBitboards(board)->pieces[!white][CH_PAWN]) {
+            newSquare = square;
+            hash ^= enPassantKeys[from % COLS];
+        }
     }
-    utAssert(rook != chPieceNull && chPieceGetType(rook) == CH_ROOK && !chPieceNeverMoved(rook));
-    removePieceAtPosition(board, chPieceGetRow(rook), chPieceGetCol(rook));
-    setPieceAtPosition(board, chPieceGetRow(rook), origCol, rook);
-    chPieceSetNeverMoved(rook, true);
+    chBoardSetEnPassantSquare(board, newSquare);
+    chBoardSetHash(board, hash);
 }
 
-// Make the move on the board.  Return true if we queened a pawn.
+// Make the move on the board.
 static inline void makeMove(chBoard board, chMove move) {
     chUndoMove undoMove;
     undoMove.move = move;
-    chPiece piece = getPieceAtPosition(board, move.fromRow, move.fromCol);
+    undoMove.hash = chBoardGetHash(board);
+    undoMove.enPassantSquare = chBoardGetEnPassantSquare(board);
+    undoMove.halfMoveClock = chBoardGetHalfMoveClock(board);
+    uint8 fromRow = moveFromRow(move);
+    uint8 fromCol = moveFromCol(move);
+    uint8 toRow = moveToRow(move);
+    uint8 toCol = moveToCol(move);
+    uint16 flags = move & MOVE_FLAGS;
+    chPiece piece = getPieceAtPosition(board, fromRow, fromCol);
     utAssert(piece != chPieceNull);
-    removePieceAtPosition(board, move.fromRow, move.fromCol);
-    chPiece target = getPieceAtPosition(board, move.toRow, move.toCol);
+    bool changesCastling = (squareBit(fromRow, fromCol) | squareBit(toRow, toCol)) & CASTLING_SQUARES;
+    uint8 oldCastlingRights = changesCastling? findCastlingRights(board) : 0;
+    removePieceAtPosition(board, fromRow, fromCol);
+    // An en passant capture takes the pawn beside the from square.
+    uint8 targetRow = flags == MOVE_EN_PASSANT? fromRow : toRow;
+    chPiece target = getPieceAtPosition(board, targetRow, toCol);
     undoMove.target = target;
     if (target != chPieceNull) {
-        removePieceAtPosition(board, move.toRow, move.toCol);
+        removePieceAtPosition(board, targetRow, toCol);
     }
-    undoMove.queenedPawn = false;
-    if (chPieceGetType(piece) == CH_PAWN && (chPieceWhite(piece)? move.toRow == 7 : move.toRow == 0)) {
-        // TODO: give the player a choice of piece type.
-        chPieceSetType(piece, CH_QUEEN);
-        undoMove.queenedPawn = true;
+    // Captures and pawn moves cannot be undone in a game, so restart the clock.
+    bool irreversible = target != chPieceNull || getPieceType(piece) == CH_PAWN;
+    chBoardSetHalfMoveClock(board, irreversible? 0 : undoMove.halfMoveClock + 1);
+    if (flags & MOVE_PROMOTION) {
+        setPieceType(piece, movePromotionType(move));
     }
-    setPieceAtPosition(board, move.toRow, move.toCol, piece);
-    if (castling(piece, move)) {
+    setPieceAtPosition(board, toRow, toCol, piece);
+    if (flags == MOVE_CASTLE) {
         finishCastling(board, move);
     }
-    undoMove.firstMove = chPieceNeverMoved(piece);
-    chPieceSetNeverMoved(piece, false);
+    undoMove.firstMove = pieceNeverMoved(piece);
+    setPieceFlag(piece, PIECE_NEVER_MOVED, false);
+    updateEnPassantSquare(board, piece, move);
+    uint64 hash = chBoardGetHash(board) ^ blackToMoveKey;
+    if (changesCastling) {
+        hash ^= castlingKeys[oldCastlingRights] ^ castlingKeys[findCastlingRights(board)];
+    }
+    chBoardSetHash(board, hash);
     uint32 undoMovePos = chBoardGetUndoMovePos(board);
     chBoardSetiUndoMove(board, undoMovePos, undoMove);
     chBoardSetUndoMovePos(board, undoMovePos + 1);
@@ -491,86 +1645,164 @@ static void undoMove(chBoard board) {
     chUndoMove undoMove = chBoardGetiUndoMove(board, undoMovePos);
     chMove move = undoMove.move;
     chPiece target = undoMove.target;
+    uint8 fromRow = moveFromRow(move);
+    uint8 toRow = moveToRow(move);
+    uint8 toCol = moveToCol(move);
+    uint16 flags = move & MOVE_FLAGS;
     chBoardSetUndoMovePos(board, undoMovePos);
-    chPiece piece = getPieceAtPosition(board, move.toRow, move.toCol);
+    chPiece piece = getPieceAtPosition(board, toRow, toCol);
     utAssert(piece != chPieceNull && piece != target);
-    removePieceAtPosition(board, move.toRow, move.toCol);
-    if (castling(piece, move)) {
+    removePieceAtPosition(board, toRow, toCol);
+    if (flags == MOVE_CASTLE) {
         finishUndoCastling(board, move);
     }
-    if (undoMove.queenedPawn) {
-        chPieceSetType(piece, CH_PAWN);
+    if (flags & MOVE_PROMOTION) {
+        setPieceType(piece, CH_PAWN);
     }
-    setPieceAtPosition(board, move.fromRow, move.fromCol, piece);
+    setPieceAtPosition(board, fromRow, moveFromCol(move), piece);
     if (undoMove.firstMove) {
-        chPieceSetNeverMoved(piece, true);
+        setPieceFlag(piece, PIECE_NEVER_MOVED, true);
     }
-    if (undoMove.target != chPieceNull) {
-        setPieceAtPosition(board, move.toRow, move.toCol, target);
+    if (target != chPieceNull) {
+        setPieceAtPosition(board, flags == MOVE_EN_PASSANT? fromRow : toRow, toCol, target);
     }
+    chBoardSetEnPassantSquare(board, undoMove.enPassantSquare);
+    chBoardSetHalfMoveClock(board, undoMove.halfMoveClock);
+    chBoardSetHash(board, undoMove.hash);
 }
 
-// Add a move to the move stack.
-static inline void addMove(chBoard board, uint8 fromRow, uint8 fromCol, uint8 toRow, uint8 toCol) {
-    chMove move;
-    move.fromRow = fromRow;
-    move.fromCol = fromCol;
-    move.toRow = toRow;
-    move.toCol = toCol;
-    uint32 stackPos = chBoardGetMoveStackPos(board);
-    if (stackPos == chBoardGetNumMove(board)) {
-        chBoardResizeMoves(board, chBoardGetNumMove(board) << 1);
+// Pass the turn to the other side, for null-move pruning.  The en passant
+// square is cleared, since it only lasts one move.
+static void makeNullMove(chBoard board) {
+    chUndoMove undoMove;
+    undoMove.move = NULL_MOVE;
+    undoMove.target = chPieceNull;
+    undoMove.firstMove = false;
+    undoMove.hash = chBoardGetHash(board);
+    undoMove.enPassantSquare = chBoardGetEnPassantSquare(board);
+    undoMove.halfMoveClock = chBoardGetHalfMoveClock(board);
+    chBoardSetHalfMoveClock(board, undoMove.halfMoveClock + 1);
+    uint64 hash = undoMove.hash ^ blackToMoveKey;
+    if (undoMove.enPassantSquare != 0) {
+        hash ^= enPassantKeys[undoMove.enPassantSquare % COLS];
+        chBoardSetEnPassantSquare(board, 0);
+    }
+    chBoardSetHash(board, hash);
+    uint32 undoMovePos = chBoardGetUndoMovePos(board);
+    chBoardSetiUndoMove(board, undoMovePos, undoMove);
+    chBoardSetUndoMovePos(board, undoMovePos + 1);
+}
+
+// Undo a null move.
+static void undoNullMove(chBoard board) {
+    uint32 undoMovePos = chBoardGetUndoMovePos(board) - 1;
+    chUndoMove undoMove = chBoardGetiUndoMove(board, undoMovePos);
+    utAssert(undoMove.move == NULL_MOVE);
+    chBoardSetUndoMovePos(board, undoMovePos);
+    chBoardSetEnPassantSquare(board, undoMove.enPassantSquare);
+    chBoardSetHalfMoveClock(board, undoMove.halfMoveClock);
+    chBoardSetHash(board, undoMove.hash);
+}
+
+// Make a move in the game, and add it to the game record.
+static void makeGameMove(chBoard board, chMove move) {
+    makeMove(board, move);
+    chBoardAppendMove(board, move);
+}
+
+// Undo the last move in the game, and remove it from the game record.
+static void undoGameMove(chBoard board) {
+    undoMove(board);
+    chBoardResizeMoves(board, chBoardGetNumMove(board) - 1);
+}
+
+// Print the game record in the form accepted by -moves.
+static void printGameRecord(chBoard board) {
+    printf("Moves: ");
+    for (uint32 i = 0; i < chBoardGetNumMove(board); i++) {
+        char text[MAX_MOVE_TEXT];
+        writeMove(chBoardGetiMove(board, i), text);
+        printf(i == 0? "%s" : ",%s", text);
     }
-    chBoardSetiMove(board, stackPos, move);
-    chBoardSetMoveStackPos(board, stackPos + 1);
+    putchar('\n');
+}
+
+// Add a move to the move list.  The list is sized for any position, so there
+// is no need to check for room.
+static inline void addMove(chMoveList *list, chMove move) {
+    list->moves[list->numMoves++] = move;
+}
+
+// Add a pawn move, or if the pawn reaches the last row, a move for each piece
+// it can be promoted to.
+static inline void addPawnMove(chMoveList *list, uint8 from, uint8 to) {
+    if (to >= COLS && to < COLS*(ROWS - 1)) {
+        addMove(list, encodeMove(from, to, 0));
+        return;
+    }
+    addMove(list, encodeMove(from, to, promotionFlags(CH_QUEEN)));
+    addMove(list, encodeMove(from, to, promotionFlags(CH_KNIGHT)));
+    addMove(list, encodeMove(from, to, promotionFlags(CH_ROOK)));
+    addMove(list, encodeMove(from, to, promotionFlags(CH_BISHOP)));
+}
+
+#if defined(DD_DEBUG)
+// Add a move from one row and column to another, for pieces other than pawns.
+static inline void addRowColMove(chMoveList *list, uint8 fromRow, uint8 fromCol, uint8 toRow, uint8 toCol) {
+    addMove(list, encodeMove(COLS*fromRow + fromCol, COLS*toRow + toCol, 0));
 }
 
 // Find moves for a pawn.
-// TODO: Add special move when taking pawn that just moved two squares.
-static void findPawnMoves(chBoard board, chPiece piece) {
-    bool white = chPieceWhite(piece);
-    uint8 row = chPieceGetRow(piece);
-    uint8 col = chPieceGetCol(piece);
+static void findPawnMoves(chBoard board, chPiece piece, chMoveList *list) {
+    bool white = pieceWhite(piece);
+    uint8 row = getPieceRow(piece);
+    uint8 col = getPieceCol(piece);
     int8 oneRow = white? 1 : -1;
     int8 twoRows = white? 2 : -2;
     if ((white && row == 1) || (!white && row == 6)) {
         // Try moving forward 2.
         if (squareEmpty(board, row + oneRow, col) && squareEmpty(board, row + twoRows, col)) {
-            addMove(board, row, col, row + twoRows, col);
+            addPawnMove(list, COLS*row + col, COLS*(row + twoRows) + col);
         }
     }
     // Try moving forward 1.
     if (squareEmpty(board, row + oneRow, col)) {
-        addMove(board, row, col, row + oneRow, col);
+        addPawnMove(list, COLS*row + col, COLS*(row + oneRow) + col);
     }
     if (col > 0) {
         // Try taking left.
         chPiece target = getPieceAtPosition(board, row + oneRow, col - 1);
-        if (target != chPieceNull && chPieceWhite(target) != white) {
-            addMove(board, row, col, row + oneRow, col - 1);
+        if (target != chPieceNull && pieceWhite(target) != white) {
+            addPawnMove(list, COLS*row + col, COLS*(row + oneRow) + col - 1);
         }
     }
     if (col < 7) {
         // Try taking right.
         chPiece target = getPieceAtPosition(board, row + oneRow, col + 1);
-        if (target != chPieceNull && chPieceWhite(target) != white) {
-            addMove(board, row, col, row + oneRow, col + 1);
+        if (target != chPieceNull && pieceWhite(target) != white) {
+            addPawnMove(list, COLS*row + col, COLS*(row + oneRow) + col + 1);
         }
     }
+    // Try taking a pawn that just moved two squares.
+    uint8 enPassantSquare = chBoardGetEnPassantSquare(board);
+    if (enPassantSquare != 0 && enPassantSquare / COLS == row + oneRow &&
+            abs8(enPassantSquare % COLS - col) == 1) {
+        addMove(list, encodeMove(COLS*row + col, enPassantSquare, MOVE_EN_PASSANT));
+    }
 }
 
 // Try moving in a direction, adding moves as we go until we hit the edge of the
 // board, one of our own pieces, or take a piece.
-static inline void tryMoves(chBoard board, chPiece piece, int8 rowDelta, int8 colDelta) {
-    bool white = chPieceWhite(piece);
-    uint8 origRow = chPieceGetRow(piece);
-    uint8 origCol = chPieceGetCol(piece);
+static inline void tryMoves(chBoard board, chPiece piece, chMoveList *list, int8 rowDelta, int8 colDelta) {
+    bool white = pieceWhite(piece);
+    uint8 origRow = getPieceRow(piece);
+    uint8 origCol = getPieceCol(piece);
     int8 row = origRow + rowDelta;
     int8 col = origCol + colDelta;
     while (row >= 0 && col >= 0 && row < ROWS && col < COLS) {
         chPiece target = getPieceAtPosition(board, row, col);
-        if (target == chPieceNull || chPieceWhite(target) != white) {
-            addMove(board, origRow, origCol, row, col);
+        if (target == chPieceNull || pieceWhite(target) != white) {
+            addRowColMove(list, origRow, origCol, row, col);
         }
         if (target != chPieceNull) {
             return;
@@ -581,11 +1813,11 @@ static inline void tryMoves(chBoard board, chPiece piece, int8 rowDelta, int8 co
 }
 
 // Find moves for a rook.
-static void findRookMoves(chBoard board, chPiece piece) {
-    tryMoves(board, piece, 1, 0);
-    tryMoves(board, piece, -1, 0);
-    tryMoves(board, piece, 0, 1);
-    tryMoves(board, piece, 0, -1);
+static void findRookMoves(chBoard board, chPiece piece, chMoveList *list) {
+    tryMoves(board, piece, list, 1, 0);
+    tryMoves(board, piece, list, -1, 0);
+    tryMoves(board, piece, list, 0, 1);
+    tryMoves(board, piece, list, 0, -1);
 }
 
 // Just check that the position is on the board.
@@ -594,9 +1826,9 @@ static inline bool rangeLegal(uint8 toRow, uint8 toCol) {
 }
 
 // Each pair are deltas to try from the current position.  Try them all.
-static void tryDeltas(chBoard board, chPiece piece, int8 *deltas, uint8 deltasLen) {
-    uint8 row = chPieceGetRow(piece);
-    uint8 col = chPieceGetCol(piece);
+static void tryDeltas(chBoard board, chPiece piece, chMoveList *list, int8 *deltas, uint8 deltasLen) {
+    uint8 row = getPieceRow(piece);
+    uint8 col = getPieceCol(piece);
     for (uint8 i = 0; i < deltasLen; i += 2) {
         int8 rowDelta = deltas[i];
         int8 colDelta = deltas[i + 1];
@@ -604,248 +1836,1832 @@ static void tryDeltas(chBoard board, chPiece piece, int8 *deltas, uint8 deltasLe
         int8 toCol = col + colDelta;
         if (rangeLegal(toRow, toCol)) {
             chPiece target = getPieceAtPosition(board, toRow, toCol);
-            if (target == chPieceNull || chPieceWhite(target) != chPieceWhite(piece)) {
-                addMove(board, row, col, toRow, toCol);
+            if (target == chPieceNull || pieceWhite(target) != pieceWhite(piece)) {
+                addRowColMove(list, row, col, toRow, toCol);
             }
         }
     }
 }
 
 // Find moves for a knight.
-static void findKnightMoves(chBoard board, chPiece piece) {
+static void findKnightMoves(chBoard board, chPiece piece, chMoveList *list) {
     int8 deltas[] = {-2, -1, -2, 1, -1, -2, -1, 2, 1, -2, 1, 2, 2, -1, 2, 1};
-    tryDeltas(board, piece, deltas, sizeof(deltas));
+    tryDeltas(board, piece, list, deltas, sizeof(deltas));
 }
 
 // Find moves for a bishop.
-static void findBishopMoves(chBoard board, chPiece piece) {
-    tryMoves(board, piece, 1, 1);
-    tryMoves(board, piece, 1, -1);
-    tryMoves(board, piece, -1, 1);
-    tryMoves(board, piece, -1, -1);
+static void findBishopMoves(chBoard board, chPiece piece, chMoveList *list) {
+    tryMoves(board, piece, list, 1, 1);
+    tryMoves(board, piece, list, 1, -1);
+    tryMoves(board, piece, list, -1, 1);
+    tryMoves(board, piece, list, -1, -1);
 }
 
 // Find moves for the queen.
-static void findQueenMoves(chBoard board, chPiece piece) {
-    tryMoves(board, piece, 1, 0);
-    tryMoves(board, piece, -1, 0);
-    tryMoves(board, piece, 0, 1);
-    tryMoves(board, piece, 0, -1);
-    tryMoves(board, piece, 1, 1);
-    tryMoves(board, piece, 1, -1);
-    tryMoves(board, piece, -1, 1);
-    tryMoves(board, piece, -1, -1);
+static void findQueenMoves(chBoard board, chPiece piece, chMoveList *list) {
+    tryMoves(board, piece, list, 1, 0);
+    tryMoves(board, piece, list, -1, 0);
+    tryMoves(board, piece, list, 0, 1);
+    tryMoves(board, piece, list, 0, -1);
+    tryMoves(board, piece, list, 1, 1);
+    tryMoves(board, piece, list, 1, -1);
+    tryMoves(board, piece, list, -1, 1);
+    tryMoves(board, piece, list, -1, -1);
 }
 
 // Find moves for the king.
-static void findKingMoves(chBoard board, chPiece piece) {
+static void findKingMoves(chBoard board, chPiece piece, chMoveList *list) {
     int8 deltas[] = {-1, -1, -1, 0, -1, 1, 0, -1, 0, 1, 1, -1, 1, 0, 1, 1};
-    tryDeltas(board, piece, deltas, sizeof(deltas));
+    tryDeltas(board, piece, list, deltas, sizeof(deltas));
     // Check for castling.
-    if (!chPieceNeverMoved(piece)) {
+    if (!pieceNeverMoved(piece)) {
         return;
     }
-    utAssert(chPieceGetCol(piece) == 4);
-    uint8 row = chPieceGetRow(piece);
+    utAssert(getPieceCol(piece) == 4);
+    uint8 row = getPieceRow(piece);
     chPiece rook = getPieceAtPosition(board, row, 7);
-    // TODO: Check for king moving through or being in check.
-    if (rook != chPieceNull && chPieceNeverMoved(rook) &&
+    if (rook != chPieceNull && pieceNeverMoved(rook) &&
             squareEmpty(board, row, 5) && squareEmpty(board, row, 6)) {
-        addMove(board, row, 4, row, 6);
+        addMove(list, encodeMove(COLS*row + 4, COLS*row + 6, MOVE_CASTLE));
     }
     rook = getPieceAtPosition(board, row, 0);
-    if (rook != chPieceNull && chPieceNeverMoved(rook) && squareEmpty(board, row, 3) &&
+    if (rook != chPieceNull && pieceNeverMoved(rook) && squareEmpty(board, row, 3) &&
             squareEmpty(board, row, 2) && squareEmpty(board, row, 1)) {
-        addMove(board, row, 4, row, 2);
+        addMove(list, encodeMove(COLS*row + 4, COLS*row + 2, MOVE_CASTLE));
     }
 }
 
 // Find all the moves the piece can make.
-static void findPieceMoves(chBoard board, chPiece piece) {
-    switch (chPieceGetType(piece)) {
-        case CH_PAWN: return findPawnMoves(board, piece);
-        case CH_ROOK: return findRookMoves(board, piece);
-        case CH_KNIGHT: return findKnightMoves(board, piece);
-        case CH_BISHOP: return findBishopMoves(board, piece);
-        case CH_QUEEN: return findQueenMoves(board, piece);
-        case CH_KING: return findKingMoves(board, piece);
+static void findPieceMoves(chBoard board, chPiece piece, chMoveList *list) {
+    switch (getPieceType(piece)) {
+        case CH_PAWN: return findPawnMoves(board, piece, list);
+        case CH_ROOK: return findRookMoves(board, piece, list);
+        case CH_KNIGHT: return findKnightMoves(board, piece, list);
+        case CH_BISHOP: return findBishopMoves(board, piece, list);
+        case CH_QUEEN: return findQueenMoves(board, piece, list);
+        case CH_KING: return findKingMoves(board, piece, list);
         default:
             utExit("Unknown piece type.");
     }
 }
 
-// Find all the possible moves for the computer and add them to the array of
-// moves on the board.
-static void findAllMoves(chBoard board, bool whitesTurn) {
+// Find all the possible moves by walking the piece list, and add them to the
+// move list, including ones that leave the king in check.  This is slow, but
+// simple enough to trust, so it is used to check the bitboard move generator.
+static void findAllPieceMoves(chBoard board, bool whitesTurn, chMoveList *list) {
+    list->numMoves = 0;
     chPiece piece;
     chForeachBoardPiece(board, piece) {
-        if (chPieceInPlay(piece) && chPieceWhite(piece) == whitesTurn) {
-            findPieceMoves(board, piece);
+        if (pieceInPlay(piece) && pieceWhite(piece) == whitesTurn) {
+            findPieceMoves(board, piece, list);
         }
     } chEndBoardPiece;
 }
+#endif
 
-// Find the index in the move stack of the given move.
-static uint32 findMoveIndex(chBoard board, chMove move, uint32 oldMoveStackPos) {
-    uint32 numMoves = chBoardGetMoveStackPos(board) - oldMoveStackPos;
-    for (uint32 i = oldMoveStackPos; i < oldMoveStackPos + numMoves; i++) {
-        chMove otherMove = chBoardGetiMove(board, i);
-        if (!memcmp(&move, &otherMove, sizeof(struct chMove_st))) {
-            return i;
-        }
+// Add a move from square to each square in targets.
+static inline void addBitboardMoves(chMoveList *list, uint8 square, uint64 targets) {
+    while (targets != 0) {
+        uint8 to = firstSquare(targets);
+        targets &= targets - 1;
+        addMove(list, encodeMove(square, to, 0));
     }
-    utExit("findMoveIndex: Unable to find move");
-    return 0;  // Dummy return.
 }
 
-// Suggest a move, looking difficulty moves ahead.  Initially, just use brute
-// force and a crappy scoring algorithm.  Perform alpha-beta tree pruning.
-static chMove suggestMove(chBoard board, uint8 difficulty, bool whitesTurn,
-        int32 minScore, int32 maxScore, int32 *retScore, uint32 *retMovesEvaluated) {
-    uint32 oldMoveStackPos = chBoardGetMoveStackPos(board);
-    findAllMoves(board, whitesTurn);
-    chMove bestMove;
-    int32 bestScore = INT32_MIN;  // Less than any possible move.
-    bool done = false;
-    uint32 numMoves = chBoardGetMoveStackPos(board) - oldMoveStackPos;
-    int32 score;
-    // Randomize the selected move by evaluting moves starting at a random
-    // position.
-    uint32 randStart = rand() % numMoves;
-    uint32 moveIndex;
-    uint32 totalMovesEvaluated = 0;
-    if (difficulty > 2) {
-        // If we still have enough depth, it is worth it to do a fast call with
-        // less depth to find a good first piece.  This helps alpha-beta tree
-        // pruning.
-        chMove bestMoveGuess = suggestMove(board, difficulty - 2, whitesTurn,
-                minScore, maxScore, &score, &totalMovesEvaluated);
-        uint32 moveIndex = findMoveIndex(board, bestMoveGuess, oldMoveStackPos);
-        // Swap the best guess move to the random start position.
-        chMove tempMove = chBoardGetiMove(board, oldMoveStackPos + randStart);
-        chBoardSetiMove(board, oldMoveStackPos + randStart, bestMoveGuess);
-        chBoardSetiMove(board, moveIndex, tempMove);
-    }
-    for (uint32 i = 0; i < numMoves && !done; i++) {
-        moveIndex = i + randStart;
-        if (moveIndex >= numMoves) {
-            moveIndex -= numMoves;
-        }
-        chMove move = chBoardGetiMove(board, oldMoveStackPos + moveIndex);
-        chPiece target = getPieceAtPosition(board, move.toRow, move.toCol);
-        makeMove(board, move);
-        totalMovesEvaluated++;
-        if (target != chPieceNull && chPieceGetType(target) == CH_KING) {
-            // Always go for the win.  Don't bother looking ahead past that.
-            // Also, prefer to win sooner.
-            score = WIN + difficulty;
-        } else {
-            if (difficulty > 0) {
-                uint32 movesEvaluated;
-                suggestMove(board, difficulty - 1, !whitesTurn, -maxScore, -minScore, &score, &movesEvaluated);
-                totalMovesEvaluated += movesEvaluated;
-                score = -score;
-            } else {
-                score = whitesTurn? chBoardGetWhiteScore(board) - chBoardGetBlackScore(board) :
-                    chBoardGetBlackScore(board) - chBoardGetWhiteScore(board);
-            }
-        }
-        if (score > bestScore) {
-            bestScore = score;
-            bestMove = move;
-            if (minScore < bestScore) {
-                minScore = bestScore;
-                if (minScore >= maxScore) {
-                    // Our oponent will not allow this scenario since she has found
-                    // a better move that wont let us get this good of a score.
-                    done = true;
-                }
-            }
-        }
-        undoMove(board);
+// Add a pawn move to each square in targets, from the square delta squares
+// behind it.
+static inline void addBitboardPushes(chMoveList *list, uint64 targets, int8 delta) {
+    while (targets != 0) {
+        uint8 to = firstSquare(targets);
+        targets &= targets - 1;
+        addPawnMove(list, to - delta, to);
     }
-    chBoardSetMoveStackPos(board, oldMoveStackPos);
-    *retScore = bestScore;
-    *retMovesEvaluated = totalMovesEvaluated;
-    return bestMove;
 }
 
-// Suggest and make a move.
-static void suggestAndMakeMove(chBoard board, bool white, uint32 difficulty,
-        char *myName, char *myPossessive, char *yourPossessive, uint32 *retMovesEvaluated) {
-    int32 score;
-    uint32 moveNum = chBoardGetUndoMovePos(board);
-    uint32 movesEvaluated;
-    chMove move = suggestMove(board, difficulty, white, -INT32_MAX, INT32_MAX, &score, &movesEvaluated);
-    chPiece piece = getPieceAtPosition(board, move.fromRow, move.fromCol);
-    printf("%u) %s move %s %s from %c%d to %c%u", moveNum, myName, myPossessive,
-            getPieceTypeName(chPieceGetType(piece)), move.fromCol + 'a',
-            move.fromRow + 1, move.toCol + 'a', move.toRow + 1);
-    chPiece target = getPieceAtPosition(board, move.toRow, move.toCol);
-    if (target != chPieceNull) {
-        if (chPieceWhite(piece) != chPieceWhite(target)) {
-            printf(" taking %s %s\n", yourPossessive, getPieceTypeName(chPieceGetType(target)));
-        } else {
-            printf(" castling.\n");
-        }
+// Find moves for one side's pawns in pawns to squares in targets, using
+// bitboards.  En passant captures are found by findBitboardEnPassantMoves.
+static void findBitboardPawnMoves(chBitboards *bitboards, bool white, uint64 pawns, uint64 targets,
+        chMoveList *list) {
+    uint64 empty = ~bitboards->occupied;
+    uint64 enemies = bitboards->colors[!white] & targets;
+    if (white) {
+        uint64 onePush = (pawns << COLS) & empty;
+        addBitboardPushes(list, ((onePush & RANK_3) << COLS) & empty & targets, 2*COLS);
+        addBitboardPushes(list, onePush & targets, COLS);
     } else {
-        putchar('\n');
+        uint64 onePush = (pawns >> COLS) & empty;
+        addBitboardPushes(list, ((onePush & RANK_6) >> COLS) & empty & targets, -2*COLS);
+        addBitboardPushes(list, onePush & targets, -COLS);
+    }
+    while (pawns != 0) {
+        uint8 square = firstSquare(pawns);
+        pawns &= pawns - 1;
+        for (uint64 attacks = pawnAttacks[white][square] & enemies; attacks != 0; attacks &= attacks - 1) {
+            addPawnMove(list, square, firstSquare(attacks));
+        }
     }
-    printf("Evaluated %u moves at difficulty %u\n", movesEvaluated, difficulty);
-    makeMove(board, move);
-    *retMovesEvaluated = movesEvaluated;
 }
 
-// Read the move from the player and return it.  If it starts with 'u', undo two
-// moves, and try again.
-static void letPlayerMove(chBoard board, bool playerWhite, uint32 difficulty) {
-    chMove move;
-    bool undo = false;
-    do {
-        move = readPlayerMove(board, playerWhite, &undo);
-        if (undo) {
-            // Player wants to undo the last two moves.
-            if (chBoardGetUndoMovePos(board) < 2) {
-                printf("No moves left to undo.\n");
-            } else {
-                undoMove(board);
-                undoMove(board);
-            }
-        }
-        if (undo) {
-            printBoard(board);
+// Add the legal en passant captures.  These are rare, and can uncover an
+// attack along the row on the king by removing two pawns from it, so each is
+// checked with kingSafeAfterMove.
+static void findBitboardEnPassantMoves(chBoard board, chBitboards *bitboards, bool white, chMoveList *list) {
+    uint8 enPassantSquare = chBoardGetEnPassantSquare(board);
+    if (enPassantSquare == 0) {
+        return;
+    }
+    uint64 takers = pawnAttacks[!white][enPassantSquare] & bitboards->pieces[white][CH_PAWN];
+    for (; takers != 0; takers &= takers - 1) {
+        chMove move = encodeMove(firstSquare(takers), enPassantSquare, MOVE_EN_PASSANT);
+        if (kingSafeAfterMove(board, move, white)) {
+            addMove(list, move);
         }
-    } while (undo);
-    makeMove(board, move);
+    }
 }
 
-int main(int argc, char **argv) {
-    int xArg = 1;
-    utStart();
-    chDatabaseStart();
-    bool playerWhite = true;
-    bool autoPlay = false;
-    uint8 difficulty = 5;
-    int32 seed = 2;
-    uint32 moveLimit = UINT32_MAX;
-    while (xArg < argc && argv[xArg][0] == '-') {
-        if (!strcmp(argv[xArg], "-a")) {
-            autoPlay = true;
-        } else if (!strcmp(argv[xArg], "-n")) {
+// Add castling moves, following the same rules as findKingMoves.  The king
+// must not be in check, and must not pass through or land on an attacked
+// square.
+static void findBitboardCastlingMoves(chBoard board, chBitboards *bitboards, bool white, chMoveList *list) {
+    chPiece king = white? chBoardGetWhiteKing(board) : chBoardGetBlackKing(board);
+    if (!pieceNeverMoved(king)) {
+        return;
+    }
+    utAssert(getPieceCol(king) == 4);
+    uint8 row = getPieceRow(king);
+    uint64 occupied = bitboards->occupied;
+    chPiece rook = getPieceAtPosition(board, row, 7);
+    if (rook != chPieceNull && pieceNeverMoved(rook) &&
+            !(occupied & (squareBit(row, 5) | squareBit(row, 6))) &&
+            !squareAttacked(bitboards, COLS*row + 5, !white) &&
+            !squareAttacked(bitboards, COLS*row + 6, !white)) {
+        addMove(list, encodeMove(COLS*row + 4, COLS*row + 6, MOVE_CASTLE));
+    }
+    rook = getPieceAtPosition(board, row, 0);
+    if (rook != chPieceNull && pieceNeverMoved(rook) &&
+            !(occupied & (squareBit(row, 1) | squareBit(row, 2) | squareBit(row, 3))) &&
+            !squareAttacked(bitboards, COLS*row + 3, !white) &&
+            !squareAttacked(bitboards, COLS*row + 2, !white)) {
+        addMove(list, encodeMove(COLS*row + 4, COLS*row + 2, MOVE_CASTLE));
+    }
+}
+
+// Find the legal moves to squares in targets using the board's bitboards, and
+// add them to the move list.  Only pieces in play for the side to move are
+// visited.  Targets must not include the side's own pieces.  The pieces giving
+// check and the pinned pieces are found once: in double check only the king
+// moves, in check other pieces must take the checker or block, and pinned
+// pieces only move along the line to their king.  Set *retInCheck to true if
+// the side to move is in check.
+static void findBitboardMoves(chBoard board, bool whitesTurn, uint64 targets, chMoveList *list,
+        bool *retInCheck) {
+    chBitboards *bitboards = getBitboards(board);
+    uint64 occupied = bitboards->occupied;
+    uint64 *pieces = bitboards->pieces[whitesTurn];
+    uint8 kingSquare = firstSquare(pieces[CH_KING]);
+    uint64 pinned;
+    uint64 checkers = findCheckers(bitboards, whitesTurn, kingSquare, &pinned);
+    *retInCheck = checkers != 0;
+    targets &= ~bitboards->pieces[!whitesTurn][CH_KING];
+    // The king may not step along the line of a slider attacking it, so look
+    // for attacks as if it were not there.
+    uint64 withoutKing = occupied & ~pieces[CH_KING];
+    uint64 kingTargets = kingAttacks[kingSquare] & targets;
+    for (; kingTargets != 0; kingTargets &= kingTargets - 1) {
+        uint8 to = firstSquare(kingTargets);
+        if (!squareAttackedThrough(bitboards, to, !whitesTurn, withoutKing)) {
+            addMove(list, encodeMove(kingSquare, to, 0));
+        }
+    }
+    if (checkers & (checkers - 1)) {
+        return;
+    }
+    if (checkers != 0) {
+        targets &= checkers | betweenSquares[kingSquare][firstSquare(checkers)];
+    }
+    findBitboardPawnMoves(bitboards, whitesTurn, pieces[CH_PAWN] & ~pinned, targets, list);
+    for (uint64 pawns = pieces[CH_PAWN] & pinned; pawns != 0; pawns &= pawns - 1) {
+        uint8 square = firstSquare(pawns);
+        findBitboardPawnMoves(bitboards, whitesTurn, pawns & -pawns, targets & lineSquares[kingSquare][square],
+                list);
+    }
+    // En passant captures count as captures, so are found only with enemy
+    // targets.
+    if (targets & bitboards->colors[!whitesTurn]) {
+        findBitboardEnPassantMoves(board, bitboards, whitesTurn, list);
+    }
+    // Pinned knights can never move.
+    for (uint64 knights = pieces[CH_KNIGHT] & ~pinned; knights != 0; knights &= knights - 1) {
+        uint8 square = firstSquare(knights);
+        addBitboardMoves(list, square, knightAttacks[square] & targets);
+    }
+    uint64 bishopsAndQueens = pieces[CH_BISHOP] | pieces[CH_QUEEN];
+    for (; bishopsAndQueens != 0; bishopsAndQueens &= bishopsAndQueens - 1) {
+        uint8 square = firstSquare(bishopsAndQueens);
+        uint64 attacks = findBishopAttacks(occupied, square) & targets;
+        if (pinned & ((uint64)1 << square)) {
+            attacks &= lineSquares[kingSquare][square];
+        }
+        addBitboardMoves(list, square, attacks);
+    }
+    uint64 rooksAndQueens = pieces[CH_ROOK] | pieces[CH_QUEEN];
+    for (; rooksAndQueens != 0; rooksAndQueens &= rooksAndQueens - 1) {
+        uint8 square = firstSquare(rooksAndQueens);
+        uint64 attacks = findRookAttacks(occupied, square) & targets;
+        if (pinned & ((uint64)1 << square)) {
+            attacks &= lineSquares[kingSquare][square];
+        }
+        addBitboardMoves(list, square, attacks);
+    }
+}
+
+// Find all the legal moves and put them in the move list.  Return true if the
+// side to move is in check, so no moves means checkmate rather than stalemate.
+static bool findAllMoves(chBoard board, bool whitesTurn, chMoveList *list) {
+    list->numMoves = 0;
+    bool inCheck;
+    findBitboardMoves(board, whitesTurn, ~getBitboards(board)->colors[whitesTurn], list, &inCheck);
+    if (!inCheck) {
+        findBitboardCastlingMoves(board, getBitboards(board), whitesTurn, list);
+    }
+    return inCheck;
+}
+
+// Find the legal captures, and pawn pushes to the last row that queen the
+// pawn.  Pushes that promote to other pieces are left out.
+static void findCaptureMoves(chBoard board, bool whitesTurn, chMoveList *list) {
+    list->numMoves = 0;
+    chBitboards *bitboards = getBitboards(board);
+    bool inCheck;
+    findBitboardMoves(board, whitesTurn, bitboards->colors[!whitesTurn], list, &inCheck);
+    uint64 pawns = bitboards->pieces[whitesTurn][CH_PAWN];
+    uint64 empty = ~bitboards->occupied;
+    uint64 pushes = whitesTurn? (pawns << COLS) & empty & ((uint64)0xff << COLS*(ROWS - 1)) :
+        (pawns >> COLS) & empty & 0xff;
+    for (; pushes != 0; pushes &= pushes - 1) {
+        uint8 to = firstSquare(pushes);
+        chMove move = encodeMove(whitesTurn? to - COLS : to + COLS, to, promotionFlags(CH_QUEEN));
+        if (kingSafeAfterMove(board, move, whitesTurn)) {
+            addMove(list, move);
+        }
+    }
+}
+
+// Find the legal moves that findCaptureMoves does not: moves to empty squares,
+// other than pushes that queen a pawn, and castling.
+static void findQuietMoves(chBoard board, bool whitesTurn, chMoveList *list) {
+    list->numMoves = 0;
+    chBitboards *bitboards = getBitboards(board);
+    bool inCheck;
+    findBitboardMoves(board, whitesTurn, ~bitboards->occupied, list, &inCheck);
+    uint32 numMoves = 0;
+    for (uint32 i = 0; i < list->numMoves; i++) {
+        chMove move = list->moves[i];
+        if (!(move & MOVE_PROMOTION) || movePromotionType(move) != CH_QUEEN) {
+            list->moves[numMoves++] = move;
+        }
+    }
+    list->numMoves = numMoves;
+    if (!inCheck) {
+        findBitboardCastlingMoves(board, bitboards, whitesTurn, list);
+    }
+}
+
+// The fifty-move rule: a game is drawn after this many half-moves without a
+// capture or pawn move.
+#define FIFTY_MOVE_PLIES 100
+
+// Light and dark squares.  Bishops on one colour can never checkmate alone.
+#define DARK_SQUARES 0xaa55aa55aa55aa55ull
+#define LIGHT_SQUARES (~DARK_SQUARES)
+
+// Return the number of times, up to limit, that the position occurred before.
+// Only positions since the last capture or pawn move can repeat, and positions
+// before a null move do not count.
+static uint32 countRepetitions(chBoard board, uint32 limit) {
+    uint64 hash = chBoardGetHash(board);
+    uint32 undoMovePos = chBoardGetUndoMovePos(board);
+    chUndoMove *undoMoves = chBoardGetUndoMoves(board);
+    uint32 plies = utMin(chBoardGetHalfMoveClock(board), undoMovePos);
+    uint32 count = 0;
+    // The undo move i plies back holds the hash of the position then.  The
+    // same side is to move every other ply.
+    for (uint32 i = 1; i <= plies && count < limit; i++) {
+        chUndoMove *undoMove = undoMoves + undoMovePos - i;
+        if (undoMove->move == NULL_MOVE) {
+            break;
+        }
+        if ((i & 1) == 0 && undoMove->hash == hash) {
+            count++;
+        }
+    }
+    return count;
+}
+
+// Return true if neither side has the material to checkmate: only kings, and
+// at most one minor piece, or only bishops all on the same colour squares.
+static inline bool insufficientMaterial(chBitboards *bitboards) {
+    uint64 (*pieces)[6] = bitboards->pieces;
+    if (pieces[true][CH_PAWN] | pieces[false][CH_PAWN] | pieces[true][CH_ROOK] | pieces[false][CH_ROOK] |
+            pieces[true][CH_QUEEN] | pieces[false][CH_QUEEN]) {
+        return false;
+    }
+    uint64 knights = pieces[true][CH_KNIGHT] | pieces[false][CH_KNIGHT];
+    uint64 bishops = pieces[true][CH_BISHOP] | pieces[false][CH_BISHOP];
+    uint64 minors = knights | bishops;
+    if ((minors & (minors - 1)) == 0) {
+        return true;
+    }
+    return knights == 0 && ((bishops & LIGHT_SQUARES) == 0 || (bishops & DARK_SQUARES) == 0);
+}
+
+// Return true if the position is drawn whatever the moves: by the fifty-move
+// rule, by dead material, or because it occurred repetitions times before.
+static inline bool positionDrawn(chBoard board, uint32 repetitions) {
+    return chBoardGetHalfMoveClock(board) >= FIFTY_MOVE_PLIES || insufficientMaterial(getBitboards(board)) ||
+        countRepetitions(board, repetitions) == repetitions;
+}
+
+// Determine if the game is over because the side to move has no legal moves,
+// or it is drawn by threefold repetition, the fifty-move rule or dead
+// material.  Set *retCheckmate to true if the side to move has no legal moves
+// and is in check.  Set *retDraw to the reason for a draw, or NULL.
+static bool gameOver(chBoard board, bool whitesTurn, bool *retCheckmate, char **retDraw) {
+    chMoveList list;
+    *retCheckmate = findAllMoves(board, whitesTurn, &list);
+    *retDraw = NULL;
+    if (list.numMoves == 0) {
+        if (!*retCheckmate) {
+            *retDraw = "Stalemate";
+        }
+        return true;
+    }
+    if (countRepetitions(board, 2) == 2) {
+        *retDraw = "The position occurred three times";
+    } else if (chBoardGetHalfMoveClock(board) >= FIFTY_MOVE_PLIES) {
+        *retDraw = "Fifty moves passed without a capture or pawn move";
+    } else if (insufficientMaterial(getBitboards(board))) {
+        *retDraw = "Neither side can checkmate";
+    }
+    return *retDraw != NULL;
+}
+
+#if defined(DD_DEBUG)
+// Verify that the moves in the list found by findAllMoves are the moves found
+// by findAllPieceMoves that do not leave the king in check.
+static void verifyAllMoves(chBoard board, bool whitesTurn, chMoveList *list) {
+    chMoveList pieceMoves;
+    findAllPieceMoves(board, whitesTurn, &pieceMoves);
+    uint32 numLegalMoves = 0;
+    for (uint32 j = 0; j < pieceMoves.numMoves; j++) {
+        if (kingSafeAfterMove(board, pieceMoves.moves[j], whitesTurn)) {
+            pieceMoves.moves[numLegalMoves++] = pieceMoves.moves[j];
+        }
+    }
+    utAssert(numLegalMoves == list->numMoves);
+    for (uint32 i = 0; i < list->numMoves; i++) {
+        bool found = false;
+        for (uint32 j = 0; j < numLegalMoves && !found; j++) {
+            found = list->moves[i] == pieceMoves.moves[j];
+        }
+        utAssert(found);
+    }
+}
+#endif
+
+// Bound types for scores in the transposition table.
+enum {BOUND_NONE, BOUND_UPPER, BOUND_LOWER, BOUND_EXACT};
+
+// One transposition table entry, unpacked.
+struct chTTEntry_st {
+    uint32 key;  // The upper 32 bits of the hash.  The lower bits pick the bucket.
+    int32 score;
+    chMove move;  // The best move found.
+    uint8 depth;  // The difficulty the position was searched to.
+    uint8 bound;
+    uint8 generation;  // The search which stored the entry.
+};
+
+typedef struct chTTEntry_st chTTEntry;
+
+// A packed transposition table entry.  Search threads share the table without
+// locks, so check holds the key and search info XORed with data.  If two
+// threads write a slot at once, the mixed up slot fails the key check and
+// reads as empty.
+struct chTTSlot_st {
+    _Atomic uint64 check;
+    _Atomic uint64 data;  // The move and score.
+};
+
+typedef struct chTTSlot_st chTTSlot;
+
+#define TT_BUCKET_SIZE 4
+#define TT_DEFAULT_MEGABYTES 16
+
+// Four slots fill a 64-byte cache line.
+struct chTTBucket_st {
+    chTTSlot slots[TT_BUCKET_SIZE];
+};
+
+typedef struct chTTBucket_st chTTBucket;
+
+static chTTBucket *ttBuckets;
+static uint64 ttMask;  // The number of buckets, minus 1.
+static uint8 ttGeneration;
+
+// Allocate the transposition table, rounding its size down to a power of 2.
+static void initTranspositionTable(uint32 megabytes) {
+    uint64 numBuckets = 1;
+    while (numBuckets*2*sizeof(chTTBucket) <= ((uint64)megabytes << 20)) {
+        numBuckets <<= 1;
+    }
+    ttBuckets = aligned_alloc(sizeof(chTTBucket), numBuckets*sizeof(chTTBucket));
+    if (ttBuckets == NULL) {
+        utExit("Unable to allocate the transposition table");
+    }
+    memset(ttBuckets, 0, numBuckets*sizeof(chTTBucket));
+    ttMask = numBuckets - 1;
+}
+
+// Empty the transposition table.
+static void clearTranspositionTable(void) {
+    memset(ttBuckets, 0, (ttMask + 1)*sizeof(chTTBucket));
+}
+
+// Free the transposition table.
+static void freeTranspositionTable(void) {
+    free(ttBuckets);
+}
+
+// Read and unpack a transposition table slot.
+static inline void readTTSlot(chTTSlot *slot, chTTEntry *entry) {
+    uint64 data = atomic_load_explicit(&slot->data, memory_order_relaxed);
+    uint64 info = atomic_load_explicit(&slot->check, memory_order_relaxed) ^ data;
+    entry->move = data >> 32;
+    entry->score = (int32)(uint32)data;
+    entry->key = info >> 32;
+    entry->depth = info >> 16;
+    entry->bound = info >> 8;
+    entry->generation = info;
+}
+
+// Pack and write a transposition table slot.
+static inline void writeTTSlot(chTTSlot *slot, chTTEntry *entry) {
+    uint64 data = ((uint64)entry->move << 32) | (uint32)entry->score;
+    uint64 info = ((uint64)entry->key << 32) | ((uint64)entry->depth << 16) |
+        ((uint64)entry->bound << 8) | entry->generation;
+    atomic_store_explicit(&slot->check, info ^ data, memory_order_relaxed);
+    atomic_store_explicit(&slot->data, data, memory_order_relaxed);
+}
+
+// Look up the hash in the transposition table.  Return true and fill in entry
+// if it is found.
+static inline bool probeTranspositionTable(uint64 hash, chTTEntry *entry) {
+    chTTSlot *slots = ttBuckets[hash & ttMask].slots;
+    uint32 key = hash >> 32;
+    for (uint8 i = 0; i < TT_BUCKET_SIZE; i++) {
+        readTTSlot(slots + i, entry);
+        if (entry->key == key && entry->bound != BOUND_NONE) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Save a search result in the transposition table.  Replace the entry for the
+// same position if there is one, otherwise the shallowest entry, preferring
+// entries left over from earlier searches.
+static inline void storeTranspositionTable(uint64 hash, chMove move, int32 score,
+        uint8 depth, uint8 bound) {
+    chTTSlot *slots = ttBuckets[hash & ttMask].slots;
+    chTTEntry entry;
+    entry.key = hash >> 32;
+    chTTSlot *slot = slots;
+    int32 worstValue = INT32_MAX;
+    for (uint8 i = 0; i < TT_BUCKET_SIZE; i++) {
+        chTTEntry oldEntry;
+        readTTSlot(slots + i, &oldEntry);
+        if (oldEntry.key == entry.key) {
+            slot = slots + i;
+            break;
+        }
+        int32 value = oldEntry.depth - (oldEntry.generation != ttGeneration? 64 : 0);
+        if (value < worstValue) {
+            worstValue = value;
+            slot = slots + i;
+        }
+    }
+    entry.score = score;
+    entry.move = move;
+    entry.depth = depth;
+    entry.bound = bound;
+    entry.generation = ttGeneration;
+    writeTTSlot(slot, &entry);
+}
+
+// Search state.  Only the main search thread checks the limits.  It sets
+// searchStopped to stop the helper threads as well.
+static atomic_bool searchStopped;
+static _Thread_local uint64 searchNodes;  // Moves evaluated so far by this thread.
+static _Thread_local uint64 quiescenceNodes;  // Captures evaluated so far in quiesce.
+static _Thread_local bool searchIsHelper;
+static _Thread_local uint64 searchRandomState;  // Helper threads use this instead of rand().
+static bool searchRandomized = true;  // Bench turns this off so node counts repeat.
+static uint64 searchAuditInterval;  // Audit the board every this many moves.  0 means never.
+static uint64 searchNodeLimit;  // 0 means no limit.
+static uint64 searchDeadline;  // In milliseconds, as returned by getTimeMs.  0 means no limit.
+static bool searchPvs = true;  // Search moves after the first with a null window.
+static bool searchAspiration = true;  // Search the root with a window around the last score.
+static bool searchNullMove = true;  // Prune with null moves.
+static bool searchLmr = true;  // Reduce the depth of late quiet moves.
+static bool searchFutility = true;  // Skip futile quiet moves near the horizon.
+static bool searchRazoring = true;  // Drop into quiesce when far behind near the horizon.
+static bool searchExchanges = true;  // Skip or postpone captures that lose material.
+
+// Return a random number less than n.  Helper threads have their own random
+// state so they do not contend for rand(), and so their searches diverge from
+// the main thread's.
+static inline uint32 randomBelow(uint32 n) {
+    if (!searchIsHelper) {
+        return rand() % n;
+    }
+    return randomKey(&searchRandomState) % n;
+}
+
+// Move ordering.  Moves are searched the hash move first, then captures and
+// queening moves by most valuable victim, least valuable attacker (MVV-LVA),
+// then the killer moves that caused a cutoff at the same ply, then quiet moves
+// by their history score.  See chMovePicker.  Killers and history are per
+// thread, so helpers do not contend for them.
+#define CAPTURE_ORDER (1 << 30)
+#define MAX_HISTORY_ORDER (1 << 28)
+static _Thread_local chMove killerMoves[MAX_DIFFICULTY + 1][2];
+static _Thread_local int32 historyScores[2][ROWS*COLS][ROWS*COLS];  // [white][from][to]
+static _Thread_local uint32 searchRootUndoPos;  // Undo stack position at the root of the search.
+
+// Values of victims and attackers, indexed by piece type, for MVV-LVA.
+static const int32 orderValues[] = {1, 5, 3, 3, 9, 100};
+
+// Return the MVV-LVA ordering score of a capture or promotion.  A promotion
+// counts as taking the material it gains.  Return 0 for other moves.
+static inline int32 findCaptureOrder(chBoard board, chMove move) {
+    uint16 flags = move & MOVE_FLAGS;
+    chPiece target = getPieceAtPosition(board, moveToRow(move), moveToCol(move));
+    int32 victim = 0;
+    if (target != chPieceNull) {
+        victim = orderValues[getPieceType(target)];
+    } else if (flags == MOVE_EN_PASSANT) {
+        victim = orderValues[CH_PAWN];
+    }
+    if (flags & MOVE_PROMOTION) {
+        victim += orderValues[movePromotionType(move)] - orderValues[CH_PAWN];
+    }
+    if (victim == 0) {
+        return 0;
+    }
+    chPiece piece = getPieceAtPosition(board, moveFromRow(move), moveFromCol(move));
+    return CAPTURE_ORDER + 256*victim - orderValues[getPieceType(piece)];
+}
+
+// Return the pieces of both sides that attack the square, when the occupied
+// squares are occupied.  Sliders are found through the pieces that are not.
+static inline uint64 findAttackers(chBitboards *bitboards, uint8 square, uint64 occupied) {
+    uint64 (*pieces)[6] = bitboards->pieces;
+    return (pawnAttacks[false][square] & pieces[true][CH_PAWN]) |
+        (pawnAttacks[true][square] & pieces[false][CH_PAWN]) |
+        (knightAttacks[square] & (pieces[true][CH_KNIGHT] | pieces[false][CH_KNIGHT])) |
+        (kingAttacks[square] & (pieces[true][CH_KING] | pieces[false][CH_KING])) |
+        (findRookAttacks(occupied, square) & (pieces[true][CH_ROOK] | pieces[false][CH_ROOK] |
+            pieces[true][CH_QUEEN] | pieces[false][CH_QUEEN])) |
+        (findBishopAttacks(occupied, square) & (pieces[true][CH_BISHOP] | pieces[false][CH_BISHOP] |
+            pieces[true][CH_QUEEN] | pieces[false][CH_QUEEN]));
+}
+
+// Piece types from least to most valuable, the order in which exchanges use them.
+static const chPieceType exchangeOrder[] = {CH_PAWN, CH_KNIGHT, CH_BISHOP, CH_ROOK, CH_QUEEN, CH_KING};
+
+// Static exchange evaluation: return the material the side moving gains from
+// the capture, if both sides then keep recapturing on its square with their
+// least valuable piece, each stopping when that would lose more.  Pieces
+// behind a capturing slider join in as it leaves ("x-rays").  Pins are
+// ignored, and a king only recaptures when the square is no longer defended.
+static int32 findExchangeScore(chBoard board, chMove move) {
+    chBitboards *bitboards = getBitboards(board);
+    uint8 from = moveFrom(move);
+    uint8 to = moveTo(move);
+    uint16 flags = move & MOVE_FLAGS;
+    chPiece piece = getPieceAtPosition(board, moveFromRow(move), moveFromCol(move));
+    chPiece target = getPieceAtPosition(board, moveToRow(move), moveToCol(move));
+    bool white = pieceWhite(piece);
+    uint64 occupied = bitboards->occupied ^ ((uint64)1 << from);
+    // gains[i] is the material won by the side making the i-th capture, if
+    // the other side stops there.
+    int32 gains[ROWS*COLS/2];
+    gains[0] = target != chPieceNull? pieceValues[getPieceType(target)] : 0;
+    int32 attackerValue = pieceValues[getPieceType(piece)];
+    if (flags == MOVE_EN_PASSANT) {
+        gains[0] = pieceValues[CH_PAWN];
+        occupied ^= (uint64)1 << (white? to - COLS : to + COLS);
+    } else if (flags & MOVE_PROMOTION) {
+        attackerValue = pieceValues[movePromotionType(move)];
+        gains[0] += attackerValue - pieceValues[CH_PAWN];
+    }
+    uint64 (*pieces)[6] = bitboards->pieces;
+    uint64 rooks = pieces[true][CH_ROOK] | pieces[false][CH_ROOK] | pieces[true][CH_QUEEN] | pieces[false][CH_QUEEN];
+    uint64 bishops = pieces[true][CH_BISHOP] | pieces[false][CH_BISHOP] | pieces[true][CH_QUEEN] |
+        pieces[false][CH_QUEEN];
+    uint64 attackers = findAttackers(bitboards, to, occupied) & occupied;
+    uint32 depth = 0;
+    while (true) {
+        white = !white;
+        uint64 sideAttackers = attackers & bitboards->colors[white];
+        if (sideAttackers == 0) {
+            break;
+        }
+        chPieceType type = CH_PAWN;
+        uint64 typeAttackers = 0;
+        for (uint8 i = 0; typeAttackers == 0; i++) {
+            type = exchangeOrder[i];
+            typeAttackers = sideAttackers & pieces[white][type];
+        }
+        if (type == CH_KING && (attackers & bitboards->colors[!white]) != 0) {
+            break;
+        }
+        depth++;
+        gains[depth] = attackerValue - gains[depth - 1];
+        if (utMax(-gains[depth - 1], gains[depth]) < 0) {
+            // Neither capturing nor stopping here changes who comes out ahead.
+            break;
+        }
+        attackerValue = pieceValues[type];
+        occupied ^= typeAttackers & -typeAttackers;
+        attackers |= (findRookAttacks(occupied, to) & rooks) | (findBishopAttacks(occupied, to) & bishops);
+        attackers &= occupied;
+    }
+    while (depth > 0) {
+        depth--;
+        gains[depth] = -utMax(-gains[depth], gains[depth + 1]);
+    }
+    return gains[0];
+}
+
+// Return true if the capture or promotion loses material by static exchange
+// evaluation.  Taking a piece worth at least the capturing one never does.
+static inline bool losingCapture(chBoard board, chMove move) {
+    if ((move & MOVE_FLAGS) == 0) {
+        chPiece piece = getPieceAtPosition(board, moveFromRow(move), moveFromCol(move));
+        chPiece target = getPieceAtPosition(board, moveToRow(move), moveToCol(move));
+        if (pieceValues[getPieceType(piece)] <= pieceValues[getPieceType(target)]) {
+            return false;
+        }
+    }
+    return findExchangeScore(board, move) < 0;
+}
+
+// Clear the killer moves, and age the history scores so the new search
+// favors what it learns itself.
+static void resetMoveOrdering(chBoard board) {
+    memset(killerMoves, 0, sizeof(killerMoves));
+    int32 *history = &historyScores[0][0][0];
+    for (uint32 i = 0; i < sizeof(historyScores)/sizeof(int32); i++) {
+        history[i] >>= 2;
+    }
+    searchRootUndoPos = chBoardGetUndoMovePos(board);
+}
+
+// Remember a quiet move that caused a beta cutoff, in the killer moves for the
+// ply, and in the history table, weighted by the depth of the search below it.
+static void updateMoveOrdering(chMove move, uint32 ply, uint8 difficulty, bool whitesTurn) {
+    chMove *killers = killerMoves[ply];
+    if (killers[0] != move) {
+        killers[1] = killers[0];
+        killers[0] = move;
+    }
+    int32 *history = &historyScores[whitesTurn][moveFrom(move)][moveTo(move)];
+    *history += (difficulty + 1)*(difficulty + 1);
+    if (*history >= MAX_HISTORY_ORDER) {
+        int32 *scores = &historyScores[0][0][0];
+        for (uint32 i = 0; i < sizeof(historyScores)/sizeof(int32); i++) {
+            scores[i] >>= 1;
+        }
+    }
+}
+
+// Return true if findCaptureMoves finds the move: a capture, en passant, or a
+// push that queens a pawn.  Other moves are quiet, and can be killers.
+static inline bool captureStageMove(chBoard board, chMove move) {
+    uint16 flags = move & MOVE_FLAGS;
+    return flags == MOVE_EN_PASSANT || (flags & MOVE_PROMOTION && movePromotionType(move) == CH_QUEEN) ||
+        getPieceAtPosition(board, moveToRow(move), moveToCol(move)) != chPieceNull;
+}
+
+// Swap the best move left, from position i on, to position i, and return it.
+// Ties go to the earlier move.
+static inline chMove selectMove(chMoveList *list, uint32 i, int32 *orderScores) {
+    uint32 bestIndex = i;
+    for (uint32 j = i + 1; j < list->numMoves; j++) {
+        if (orderScores[j] > orderScores[bestIndex]) {
+            bestIndex = j;
+        }
+    }
+    chMove move = list->moves[bestIndex];
+    if (bestIndex != i) {
+        list->moves[bestIndex] = list->moves[i];
+        list->moves[i] = move;
+        int32 order = orderScores[bestIndex];
+        orderScores[bestIndex] = orderScores[i];
+        orderScores[i] = order;
+    }
+    return move;
+}
+
+// Randomize the selected move among equally good ones by rotating the moves to
+// start at a random position.  Ties go to earlier moves.
+static void rotateMoves(chMoveList *list) {
+    uint32 numMoves = list->numMoves;
+    if (numMoves == 0) {
+        return;
+    }
+    uint32 randStart = randomBelow(numMoves);
+    chMove moves[MAX_MOVES];
+    memcpy(moves, list->moves, numMoves*sizeof(chMove));
+    for (uint32 i = 0; i < numMoves; i++) {
+        list->moves[i] = moves[(i + randStart) % numMoves];
+    }
+}
+
+// The stages of a move picker.  Each stage's moves are generated only when the
+// earlier stages fail to cause a cutoff.
+#define PICK_HASH_MOVE 0
+#define PICK_GEN_CAPTURES 1
+#define PICK_CAPTURES 2
+#define PICK_KILLERS 3
+#define PICK_GEN_QUIETS 4
+#define PICK_QUIETS 5
+#define PICK_BAD_CAPTURES 6
+#define PICK_DONE 7
+
+// Picks the legal moves of a position one at a time, in move ordering order:
+// the hash move, which is checked but not generated, then captures and
+// queening pushes by MVV-LVA, then the killers, then the quiet moves by
+// history, then the captures that lose material by static exchange
+// evaluation.  When capturesOnly is set, as in the quiescence search, the
+// picker stops after the captures, and skips the losing ones.
+struct chMovePicker_st {
+    chBoard board;
+    bool whitesTurn;
+    bool capturesOnly;
+    bool randomize;  // Rotate each stage's moves, to vary the root move.
+    uint8 stage;
+    chMove hashMove;
+    chMove *killers;  // NULL for none.
+    uint32 next;  // Index of the next killer, or move in the list.
+    chMoveList list;  // The current stage's moves.
+    chMoveList badCaptures;
+    int32 orderScores[MAX_MOVES];
+};
+
+typedef struct chMovePicker_st chMovePicker;
+
+// Start picking moves.  The hash move must be legal, or NULL_MOVE.
+static void initMovePicker(chMovePicker *picker, chBoard board, bool whitesTurn, chMove hashMove,
+        chMove *killers, bool capturesOnly, bool randomize) {
+    picker->board = board;
+    picker->whitesTurn = whitesTurn;
+    picker->capturesOnly = capturesOnly;
+    picker->randomize = randomize;
+    picker->stage = PICK_HASH_MOVE;
+    picker->hashMove = hashMove;
+    picker->killers = killers;
+    picker->badCaptures.numMoves = 0;
+}
+
+// Return true if the move was already returned by the hash move or killer stage.
+static inline bool movePicked(chMovePicker *picker, chMove move) {
+    chMove *killers = picker->killers;
+    return move == picker->hashMove || (killers != NULL && (move == killers[0] || move == killers[1]));
+}
+
+// Return the next move, or NULL_MOVE when there are no more.
+static chMove nextMove(chMovePicker *picker) {
+    chBoard board = picker->board;
+    chMoveList *list = &picker->list;
+    while (true) {
+        switch (picker->stage) {
+        case PICK_HASH_MOVE:
+            picker->stage = PICK_GEN_CAPTURES;
+            if (picker->hashMove != NULL_MOVE) {
+                return picker->hashMove;
+            }
+            break;
+        case PICK_GEN_CAPTURES:
+            findCaptureMoves(board, picker->whitesTurn, list);
+            if (picker->randomize) {
+                rotateMoves(list);
+            }
+            for (uint32 i = 0; i < list->numMoves; i++) {
+                picker->orderScores[i] = findCaptureOrder(board, list->moves[i]);
+            }
+            picker->next = 0;
+            picker->stage = PICK_CAPTURES;
+            // Fall through.
+        case PICK_CAPTURES:
+            while (picker->next < list->numMoves) {
+                chMove move = selectMove(list, picker->next++, picker->orderScores);
+                if (move != picker->hashMove) {
+                    if (!searchExchanges || !losingCapture(board, move)) {
+                        return move;
+                    }
+                    addMove(&picker->badCaptures, move);
+                }
+            }
+            picker->next = 0;
+            picker->stage = picker->capturesOnly? PICK_DONE : PICK_KILLERS;
+            break;
+        case PICK_KILLERS:
+            while (picker->killers != NULL && picker->next < 2) {
+                chMove move = picker->killers[picker->next++];
+                if (move != NULL_MOVE && move != picker->hashMove && !captureStageMove(board, move) &&
+                        moveLegal(board, move, picker->whitesTurn)) {
+                    return move;
+                }
+            }
+            picker->stage = PICK_GEN_QUIETS;
+            break;
+        case PICK_GEN_QUIETS:
+            findQuietMoves(board, picker->whitesTurn, list);
+            if (picker->randomize) {
+                rotateMoves(list);
+            }
+            for (uint32 i = 0; i < list->numMoves; i++) {
+                chMove move = list->moves[i];
+                picker->orderScores[i] = historyScores[picker->whitesTurn][moveFrom(move)][moveTo(move)];
+            }
+            picker->next = 0;
+            picker->stage = PICK_QUIETS;
+            // Fall through.
+        case PICK_QUIETS:
+            while (picker->next < list->numMoves) {
+                chMove move = selectMove(list, picker->next++, picker->orderScores);
+                if (!movePicked(picker, move)) {
+                    return move;
+                }
+            }
+            picker->next = 0;
+            picker->stage = PICK_BAD_CAPTURES;
+            break;
+        case PICK_BAD_CAPTURES:
+            if (picker->next < picker->badCaptures.numMoves) {
+                return picker->badCaptures.moves[picker->next++];
+            }
+            picker->stage = PICK_DONE;
+            break;
+        default:
+            return NULL_MOVE;
+        }
+    }
+}
+
+// Return the current time in milliseconds.
+static uint64 getTimeMs(void) {
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
+    return (uint64)now.tv_sec*1000 + now.tv_nsec/1000000;
+}
+
+// Stop the search if it has run out of time or nodes.
+static void checkSearchLimits(void) {
+    if ((searchNodeLimit != 0 && searchNodes + quiescenceNodes >= searchNodeLimit) ||
+            (searchDeadline != 0 && getTimeMs() >= searchDeadline)) {
+        searchStopped = true;
+    }
+}
+
+// Pawn structure.  Pawns move rarely next to the other pieces, so the score of
+// each pawn structure is cached in a small per-thread table, keyed by the
+// board's pawn hash.  Scores are packed middlegame and endgame scores.
+#define PAWN_TABLE_SIZE (1 << 14)  // Entries per thread.  A power of 2.
+#define DOUBLED_PAWN_SCORE makeScore(-100, -200)  // For each pawn behind another.
+#define ISOLATED_PAWN_SCORE makeScore(-150, -200)
+// A passed pawn whose next square is empty.  This depends on the other
+// pieces, so it is not cached.
+#define FREE_PASSED_PAWN_SCORE makeScore(50, 150)
+// Passed pawn scores, indexed by how many rows the pawn has advanced.
+static const int64 passedPawnScores[ROWS] = {0, makeScore(0, 100), makeScore(50, 150), makeScore(100, 250),
+    makeScore(200, 400), makeScore(350, 650), makeScore(600, 1000), 0};
+
+// Masks filled in by initPawnMasks.
+static uint64 fileMasks[COLS];
+static uint64 adjacentFileMasks[COLS];
+// The squares ahead of a pawn on its own and adjacent columns.  The pawn is
+// passed if no enemy pawn is on them.  Indexed by [white][square].
+static uint64 passedPawnMasks[2][ROWS*COLS];
+
+// A cached pawn structure.
+struct chPawnEntry_st {
+    uint64 pawnHash;
+    int64 score;  // White's minus black's.
+    uint64 passedPawns;  // Both sides' passed pawns.
+};
+
+typedef struct chPawnEntry_st chPawnEntry;
+
+// Zeroed entries match boards with no pawns, whose pawn hash is 0, and score 0.
+static _Thread_local chPawnEntry pawnTable[PAWN_TABLE_SIZE];
+
+// Fill in the column and passed pawn masks.
+static void initPawnMasks(void) {
+    for (uint8 col = 0; col < COLS; col++) {
+        fileMasks[col] = (uint64)0x0101010101010101 << col;
+    }
+    for (uint8 col = 0; col < COLS; col++) {
+        adjacentFileMasks[col] = (col > 0? fileMasks[col - 1] : 0) | (col < COLS - 1? fileMasks[col + 1] : 0);
+    }
+    for (uint8 square = 0; square < ROWS*COLS; square++) {
+        uint8 row = square / COLS;
+        uint64 span = fileMasks[square % COLS] | adjacentFileMasks[square % COLS];
+        passedPawnMasks[true][square] = row < ROWS - 1? span & (~(uint64)0 << COLS*(row + 1)) : 0;
+        passedPawnMasks[false][square] = span & (((uint64)1 << COLS*row) - 1);
+    }
+}
+
+// Return the score of one side's pawn structure, and add its passed pawns to
+// *passedPawns.
+static int64 findPawnStructureScore(chBitboards *bitboards, bool white, uint64 *passedPawns) {
+    uint64 pawns = bitboards->pieces[white][CH_PAWN];
+    uint64 enemyPawns = bitboards->pieces[!white][CH_PAWN];
+    int64 score = 0;
+    for (uint8 col = 0; col < COLS; col++) {
+        uint8 numPawns = __builtin_popcountll(pawns & fileMasks[col]);
+        if (numPawns > 1) {
+            score += (numPawns - 1)*DOUBLED_PAWN_SCORE;
+        }
+    }
+    for (uint64 left = pawns; left != 0; left &= left - 1) {
+        uint8 square = firstSquare(left);
+        uint8 col = square % COLS;
+        if (!(pawns & adjacentFileMasks[col])) {
+            score += ISOLATED_PAWN_SCORE;
+        }
+        uint64 ahead = passedPawnMasks[white][square];
+        // Only the front pawn of doubled pawns is passed.
+        if (!(enemyPawns & ahead) && !(pawns & ahead & fileMasks[col])) {
+            *passedPawns |= (uint64)1 << square;
+            uint8 row = square / COLS;
+            score += passedPawnScores[white? row : ROWS - 1 - row];
+        }
+    }
+    return score;
+}
+
+// Return the pawn structure score, white's minus black's, looking it up in the
+// pawn table first.
+static inline int64 findPawnScore(chBoard board) {
+    chBitboards *bitboards = getBitboards(board);
+    uint64 pawnHash = chBoardGetPawnHash(board);
+    chPawnEntry *entry = &pawnTable[pawnHash & (PAWN_TABLE_SIZE - 1)];
+    if (entry->pawnHash != pawnHash) {
+        uint64 passedPawns = 0;
+        entry->score = findPawnStructureScore(bitboards, true, &passedPawns) -
+            findPawnStructureScore(bitboards, false, &passedPawns);
+        entry->passedPawns = passedPawns;
+        entry->pawnHash = pawnHash;
+    }
+    uint64 empty = ~bitboards->occupied;
+    uint64 passedPawns = entry->passedPawns;
+    uint64 whiteFree = ((passedPawns & bitboards->pieces[true][CH_PAWN]) << COLS) & empty;
+    uint64 blackFree = ((passedPawns & bitboards->pieces[false][CH_PAWN]) >> COLS) & empty;
+    return entry->score + (__builtin_popcountll(whiteFree) - __builtin_popcountll(blackFree))*FREE_PASSED_PAWN_SCORE;
+}
+
+// Blend the packed score, which is from white's point of view, from the
+// middlegame to the endgame score by the game phase, and return it from the
+// side to move's point of view.
+static inline int32 blendScore(chBoard board, int64 score, bool whitesTurn) {
+    int32 phase = utMin(chBoardGetPhase(board), MAX_PHASE);
+    int32 blended = (middlegameScore(score)*phase + endgameScore(score)*(MAX_PHASE - phase))/MAX_PHASE;
+    return whitesTurn? blended : -blended;
+}
+
+// Return the static score from the side to move's point of view: material,
+// piece-square and pawn structure scores, blended from the middlegame to the
+// endgame scores by the game phase.  A loaded network replaces all of that.
+static inline int32 findStaticScore(chBoard board, bool whitesTurn) {
+    if (network != NULL) {
+        return findNetworkScore(board, whitesTurn);
+    }
+    return blendScore(board, chBoardGetWhiteScore(board) - chBoardGetBlackScore(board) + findPawnScore(board),
+        whitesTurn);
+}
+
+// Lazy evaluation: the pawn structure terms rarely move the score by more
+// than this.
+#define LAZY_EVAL_MARGIN 3000
+
+// Return the static score, or when the material and piece-square score alone,
+// which are kept incrementally, is more than LAZY_EVAL_MARGIN outside
+// (minScore, maxScore), return that instead, and skip the pawn hash probe.
+// The caller only learns that the score is outside the window.  A network's
+// score can be anywhere relative to the piece-square score, so with one loaded
+// it is always computed.
+static inline int32 findLazyStaticScore(chBoard board, bool whitesTurn, int32 minScore, int32 maxScore) {
+    if (network != NULL) {
+        return findNetworkScore(board, whitesTurn);
+    }
+    int32 score = blendScore(board, chBoardGetWhiteScore(board) - chBoardGetBlackScore(board), whitesTurn);
+    if ((int64)score + LAZY_EVAL_MARGIN <= minScore || (int64)score - LAZY_EVAL_MARGIN >= maxScore) {
+        return score;
+    }
+    return findStaticScore(board, whitesTurn);
+}
+
+// Score the position for the side to move, searching only captures and
+// queening moves, so the score is never taken in the middle of an exchange.
+// The side to move can always decline to capture, so the static score is a
+// lower bound ("stand pat"), unless it is in check, in which case every move
+// out of check is searched, and having none loses.  Captures are tried in
+// MVV-LVA order, and those that lose material by static exchange evaluation
+// are not tried.  Positions where neither side can mate score as draws.
+static int32 quiesce(chBoard board, bool whitesTurn, int32 minScore, int32 maxScore) {
+    if (insufficientMaterial(getBitboards(board))) {
+        return 0;
+    }
+    bool inCheck = kingInCheck(board, whitesTurn);
+    int32 bestScore = inCheck? -WIN : findLazyStaticScore(board, whitesTurn, minScore, maxScore);
+    if (bestScore >= maxScore) {
+        return bestScore;
+    }
+    if (bestScore > minScore) {
+        minScore = bestScore;
+    }
+    chMovePicker picker;
+    initMovePicker(&picker, board, whitesTurn, NULL_MOVE, NULL, !inCheck, false);
+    chMove move;
+    while (!searchStopped && (move = nextMove(&picker)) != NULL_MOVE) {
+        makeMove(board, move);
+        if ((++quiescenceNodes & 1023) == 0 && !searchIsHelper) {
+            checkSearchLimits();
+        }
+        if (searchAuditInterval != 0 && quiescenceNodes % searchAuditInterval == 0) {
+            auditBoard(board, !whitesTurn);
+        }
+        int32 score = -quiesce(board, !whitesTurn, -maxScore, -minScore);
+        undoMove(board);
+        if (score > bestScore) {
+            bestScore = score;
+            if (bestScore > minScore) {
+                minScore = bestScore;
+                if (minScore >= maxScore) {
+                    break;
+                }
+            }
+        }
+    }
+    return bestScore;
+}
+
+// Null-move pruning: if passing the turn still scores at least maxScore in a
+// search this much shallower, assume some move will too.  Deeper nodes are
+// reduced more.
+#define NULL_MOVE_MIN_DIFFICULTY 2
+#define NULL_MOVE_REDUCTION(difficulty) ((difficulty) > 6? 3 : 2)
+// Late move reductions: quiet moves after the first LMR_MIN_MOVES are searched
+// shallower, and again at full depth only if they beat minScore.
+#define LMR_MIN_DIFFICULTY 3
+#define LMR_MIN_MOVES 3
+
+// Futility pruning: near the horizon, a quiet move that does not give check
+// barely changes the score, so when the score plus the margin for the depth
+// left is still no better than minScore, the move is skipped.
+static const int32 futilityMargins[] = {1000, 3000};  // Indexed by difficulty.
+// Razoring: when the score is this far below minScore near the horizon, and
+// the captures cannot win it back, the node fails low without searching
+// quiet moves.
+static const int32 razorMargins[] = {2000, 4000};  // Indexed by difficulty.
+
+// Return true if the side has a piece other than pawns and its king.  Without
+// one, zugzwang is common, so passing is not a safe guess of the score.
+static inline bool hasNonPawnMaterial(chBoard board, bool white) {
+    uint64 *pieces = getBitboards(board)->pieces[white];
+    return (pieces[CH_ROOK] | pieces[CH_KNIGHT] | pieces[CH_BISHOP] | pieces[CH_QUEEN]) != 0;
+}
+
+// Return true if the last move made on the board was a null move.
+static inline bool lastMoveNull(chBoard board) {
+    uint32 undoMovePos = chBoardGetUndoMovePos(board);
+    return undoMovePos != 0 && chBoardGetiUndoMove(board, undoMovePos - 1).move == NULL_MOVE;
+}
+
+// Suggest a move, looking difficulty moves ahead, with an alpha-beta principal
+// variation search.  Draws, the transposition table, razoring, null moves,
+// futility pruning and late move reductions cut the tree down, and quiesce
+// scores the positions at the horizon.
+static chMove suggestMove(chBoard board, uint8 difficulty, bool whitesTurn,
+        int32 minScore, int32 maxScore, int32 *retScore, uint32 *retMovesEvaluated) {
+    uint32 ply = chBoardGetUndoMovePos(board) - searchRootUndoPos;
+    // A side that could avoid repeating a position would have, so score the
+    // first repetition as a draw, rather than searching it again.
+    if (ply != 0 && positionDrawn(board, 1)) {
+        *retScore = 0;
+        *retMovesEvaluated = 0;
+        return NULL_MOVE;
+    }
+    uint64 hash = chBoardGetHash(board);
+    chTTEntry entry;
+    // Hash collisions can return another position's move, so check it.  The
+    // hash move is searched before any moves are generated, so it must be
+    // legal.
+    bool haveHashMove = probeTranspositionTable(hash, &entry) &&
+        moveLegal(board, entry.move, whitesTurn);
+    if (haveHashMove && entry.depth >= difficulty) {
+        int32 score = entry.score;
+        if (entry.bound == BOUND_EXACT || (entry.bound == BOUND_LOWER && score >= maxScore) ||
+                (entry.bound == BOUND_UPPER && score <= minScore)) {
+            *retScore = score;
+            *retMovesEvaluated = 0;
+            return entry.move;
+        }
+    }
+    int32 origMinScore = minScore;
+    bool inCheck = kingInCheck(board, whitesTurn);
+    bool nullWindowNode = (int64)maxScore - minScore == 1;
+    bool razor = searchRazoring && nullWindowNode && difficulty < sizeof(razorMargins)/sizeof(int32);
+    bool nullMove = searchNullMove && nullWindowNode && difficulty >= NULL_MOVE_MIN_DIFFICULTY;
+    bool futile = searchFutility && difficulty < sizeof(futilityMargins)/sizeof(int32);
+    // Only evaluate the position if razoring, null moves or futility pruning need it.
+    int32 staticScore = 0;
+    if (ply != 0 && !inCheck && (razor || nullMove || futile)) {
+        staticScore = findLazyStaticScore(board, whitesTurn, minScore, maxScore);
+    } else {
+        razor = nullMove = futile = false;
+    }
+    uint32 totalMovesEvaluated = 0;
+    if (razor && staticScore + razorMargins[difficulty] <= minScore) {
+        int32 score = quiesce(board, whitesTurn, minScore, maxScore);
+        if (score <= minScore || searchStopped) {
+            *retScore = score;
+            *retMovesEvaluated = 0;
+            return NULL_MOVE;
+        }
+    }
+    if (nullMove && !lastMoveNull(board) && hasNonPawnMaterial(board, whitesTurn) && staticScore >= maxScore) {
+        uint8 reduction = NULL_MOVE_REDUCTION(difficulty);
+        int32 score;
+        makeNullMove(board);
+        if (difficulty > reduction) {
+            uint32 movesEvaluated;
+            suggestMove(board, difficulty - 1 - reduction, !whitesTurn, -maxScore, -maxScore + 1, &score,
+                    &movesEvaluated);
+            totalMovesEvaluated += movesEvaluated;
+            // A stopped search can return INT32_MIN, which cannot be negated.
+            if (!searchStopped) {
+                score = -score;
+            }
+        } else {
+            score = -quiesce(board, !whitesTurn, -maxScore, -maxScore + 1);
+        }
+        undoNullMove(board);
+        if (score >= maxScore && !searchStopped) {
+            // Do not trust a mate score found without a real move.
+            *retScore = score >= WIN? maxScore : score;
+            *retMovesEvaluated = totalMovesEvaluated;
+            return NULL_MOVE;
+        }
+    }
+#if defined(DD_DEBUG)
+    chMoveList allMoves;
+    findAllMoves(board, whitesTurn, &allMoves);
+    verifyAllMoves(board, whitesTurn, &allMoves);
+#endif
+    utAssert(ply <= MAX_DIFFICULTY);  // Each ply uses up at least one level of difficulty.
+    chMovePicker picker;
+    initMovePicker(&picker, board, whitesTurn, haveHashMove? entry.move : NULL_MOVE, killerMoves[ply],
+        false, ply == 0 && searchRandomized);
+    int32 bestScore = INT32_MIN;  // Less than any possible move.
+    chMove bestMove = NULL_MOVE;
+    bool done = false;
+    int32 score;
+    uint32 movesSearched = 0;
+    uint32 movesPruned = 0;
+    int32 futilityScore = INT32_MAX;  // Above any minScore, so nothing is pruned.
+    if (futile) {
+        futilityScore = staticScore + futilityMargins[difficulty];
+    }
+    chMove move;
+    while (!done && !searchStopped && (move = nextMove(&picker)) != NULL_MOVE) {
+        if (bestMove == NULL_MOVE) {
+            // Only returned if the search is stopped before any move is scored.
+            bestMove = move;
+        }
+        bool quiet = !captureStageMove(board, move);
+        if (quiet && futilityScore <= minScore && !quietMoveGivesCheck(board, move, whitesTurn)) {
+            // The move is futile.  Its score is at most futilityScore.
+            if (futilityScore > bestScore) {
+                bestScore = futilityScore;
+            }
+            movesPruned++;
+            continue;
+        }
+        movesSearched++;
+        makeMove(board, move);
+#if defined(DD_DEBUG)
+        utAssert(chBoardGetHash(board) == findHash(board, !whitesTurn));
+#endif
+        totalMovesEvaluated++;
+        if ((++searchNodes & 1023) == 0 && !searchIsHelper) {
+            checkSearchLimits();
+        }
+        if (searchAuditInterval != 0 && searchNodes % searchAuditInterval == 0) {
+            auditBoard(board, !whitesTurn);
+        }
+        // Late move reduction: a quiet move this late in the ordering, which
+        // does not give check, is unlikely to be best, so search it shallower.
+        uint8 reduction = 0;
+        if (searchLmr && picker.stage == PICK_QUIETS && movesSearched > LMR_MIN_MOVES &&
+                difficulty >= LMR_MIN_DIFFICULTY && !inCheck && !kingInCheck(board, !whitesTurn)) {
+            reduction = movesSearched > 2*LMR_MIN_MOVES + 1? 2 : 1;
+        }
+        // Principal variation search: once a move has been searched, expect
+        // the rest to be worse, and prove it with a null window.  Search again
+        // at full depth if a reduced move beats minScore, and with the full
+        // window if a move turns out better.
+        bool nullWindow = searchPvs && movesSearched > 1;
+        int32 childMaxScore = nullWindow || reduction != 0? minScore + 1 : maxScore;
+        while (true) {
+            if (difficulty > 0) {
+                uint32 movesEvaluated;
+                suggestMove(board, difficulty - 1 - reduction, !whitesTurn, -childMaxScore, -minScore, &score,
+                        &movesEvaluated);
+                totalMovesEvaluated += movesEvaluated;
+                if (searchStopped) {
+                    break;
+                }
+                score = -score;
+            } else {
+                score = -quiesce(board, !whitesTurn, -childMaxScore, -minScore);
+            }
+            if (searchStopped || score <= minScore) {
+                break;
+            }
+            if (reduction != 0) {
+                reduction = 0;
+                childMaxScore = nullWindow? minScore + 1 : maxScore;
+            } else if (childMaxScore == maxScore || score >= maxScore) {
+                break;
+            } else {
+                childMaxScore = maxScore;
+            }
+        }
+        if (searchStopped) {
+            // The score is meaningless.
+            undoMove(board);
+            break;
+        }
+        if (score > bestScore) {
+            bestScore = score;
+            bestMove = move;
+            if (minScore < bestScore) {
+                minScore = bestScore;
+                if (minScore >= maxScore) {
+                    // Our oponent will not allow this scenario since she has found
+                    // a better move that wont let us get this good of a score.
+                    done = true;
+                    if (quiet) {
+                        updateMoveOrdering(move, ply, difficulty, whitesTurn);
+                    }
+                }
+            }
+        }
+        undoMove(board);
+    }
+    if (bestMove == NULL_MOVE && !searchStopped) {
+        // Checkmate or stalemate.  Prefer to be mated later, so the winner
+        // prefers to mate sooner.
+        *retScore = inCheck? -(WIN + difficulty) : 0;
+        *retMovesEvaluated = 0;
+        return NULL_MOVE;
+    }
+#if defined(DD_DEBUG)
+    utAssert(done || searchStopped || movesSearched + movesPruned == allMoves.numMoves);
+#endif
+    if (!searchStopped) {
+        uint8 bound = bestScore >= maxScore? BOUND_LOWER :
+            bestScore > origMinScore? BOUND_EXACT : BOUND_UPPER;
+        storeTranspositionTable(hash, bestMove, bestScore, difficulty, bound);
+    }
+    *retScore = bestScore;
+    *retMovesEvaluated = totalMovesEvaluated;
+    return bestMove;
+}
+
+// A Lazy SMP helper thread.  Each helper searches the root position on its
+// own copy of the board, and shares results with the others only through the
+// transposition table.
+struct chHelper_st {
+    pthread_t thread;
+    chBoard board;
+    uint32 id;
+    bool whitesTurn;
+    uint8 maxDifficulty;
+    uint64 nodes;  // Moves evaluated, set when the thread finishes.
+};
+
+typedef struct chHelper_st chHelper;
+
+#define MAX_THREADS 256
+
+static uint32 numSearchThreads = 1;
+static chHelper helpers[MAX_THREADS - 1];
+
+// Run a helper thread's iterative search until the main thread stops it.
+static void *runHelper(void *arg) {
+    chHelper *helper = arg;
+    searchIsHelper = true;
+    searchNodes = 0;
+    quiescenceNodes = 0;
+    searchRandomState = 0x9e3779b97f4a7c15ull*(helper->id + 1);
+    resetMoveOrdering(helper->board);
+    // Odd helpers skip a difficulty, so not every thread is on the same one.
+    uint8 difficulty = helper->id & 1;
+    while (!searchStopped && difficulty <= helper->maxDifficulty) {
+        int32 score;
+        uint32 movesEvaluated;
+        suggestMove(helper->board, difficulty, helper->whitesTurn, -INT32_MAX, INT32_MAX,
+                &score, &movesEvaluated);
+        difficulty++;
+    }
+    helper->nodes = searchNodes + quiescenceNodes;
+    return NULL;
+}
+
+// Start the helper threads searching the board's position.  Boards are
+// created and copied here, since DataDraw objects must not be allocated
+// while threads are running.
+static void startHelpers(chBoard board, bool whitesTurn, uint8 maxDifficulty) {
+    for (uint32 i = 0; i < numSearchThreads - 1; i++) {
+        chHelper *helper = helpers + i;
+        if (helper->board == chBoardNull) {
+            helper->board = chBoardCreateEmpty(chBoardPlayerWhite(board));
+        }
+        copyBoard(helper->board, board);
+        helper->id = i + 1;
+        helper->whitesTurn = whitesTurn;
+        helper->maxDifficulty = maxDifficulty;
+    }
+    for (uint32 i = 0; i < numSearchThreads - 1; i++) {
+        chHelper *helper = helpers + i;
+        if (pthread_create(&helper->thread, NULL, runHelper, helper) != 0) {
+            utExit("Unable to start search thread");
+        }
+    }
+}
+
+// Wait for the helper threads to stop, and return the moves they evaluated.
+static uint64 stopHelpers(void) {
+    uint64 nodes = 0;
+    searchStopped = true;
+    for (uint32 i = 0; i < numSearchThreads - 1; i++) {
+        pthread_join(helpers[i].thread, NULL);
+        nodes += helpers[i].nodes;
+    }
+    return nodes;
+}
+
+// The half-width of the first aspiration window, a quarter of a pawn.
+#define ASPIRATION_WINDOW 250
+
+// Search with difficulty 0, 1, 2... up to maxDifficulty, until the time or
+// node budget runs out, and return the best move from the deepest search that
+// finished.  A budget of 0 means no limit.  Budgets only apply once the first
+// search has finished, so there is always a move.  The node budget counts
+// only the main thread's moves.
+static chMove searchIteratively(chBoard board, bool whitesTurn, uint8 maxDifficulty,
+        uint32 milliseconds, uint64 nodeLimit, uint8 *retDifficulty, uint64 *retMovesEvaluated) {
+    uint64 startTime = getTimeMs();
+    chMove bestMove = NULL_MOVE;
+    uint8 difficulty = 0;
+    int32 lastScore = 0;
+    searchStopped = false;
+    searchNodes = 0;
+    quiescenceNodes = 0;
+    searchNodeLimit = 0;
+    searchDeadline = 0;
+    *retDifficulty = 0;
+    ttGeneration++;
+    resetMoveOrdering(board);
+    // Leave room on the undo stack for the deepest search line, including
+    // captures in quiesce.  Resize before starting helpers, since they share
+    // the DataDraw heap.
+    uint32 numUndoMoves = chBoardGetNumUndoMove(board);
+    if (chBoardGetUndoMovePos(board) + MAX_SEARCH_DEPTH >= numUndoMoves) {
+        chBoardResizeUndoMoves(board, numUndoMoves << 1);
+    }
+    startHelpers(board, whitesTurn, maxDifficulty);
+    do {
+        int32 score;
+        uint32 movesEvaluated;
+        int32 minScore = -INT32_MAX;
+        int32 maxScore = INT32_MAX;
+        int32 window = ASPIRATION_WINDOW;
+        if (searchAspiration && difficulty > 0 && abs(lastScore) < WIN) {
+            minScore = lastScore - window;
+            maxScore = lastScore + window;
+        }
+        chMove move;
+        while (true) {
+            move = suggestMove(board, difficulty, whitesTurn, minScore, maxScore, &score, &movesEvaluated);
+            if (searchStopped || (score > minScore && score < maxScore)) {
+                break;
+            }
+            // The score is outside the window, so it is only a bound.  Widen
+            // the side it fell out of and search again.
+            window *= 4;
+            if (score <= minScore) {
+                minScore = window >= WIN || abs(score) >= WIN? -INT32_MAX : score - window;
+            } else {
+                maxScore = window >= WIN || abs(score) >= WIN? INT32_MAX : score + window;
+            }
+        }
+        if (searchStopped) {
+            break;
+        }
+        lastScore = score;
+        bestMove = move;
+        *retDifficulty = difficulty;
+        searchNodeLimit = nodeLimit;
+        if (milliseconds != 0) {
+            searchDeadline = startTime + milliseconds;
+            // The next search takes several times longer than this one, so do
+            // not start it if it is unlikely to finish.
+            if (2*(getTimeMs() - startTime) > milliseconds) {
+                break;
+            }
+        }
+        checkSearchLimits();
+    } while (!searchStopped && difficulty++ < maxDifficulty);
+    *retMovesEvaluated = searchNodes + quiescenceNodes + stopHelpers();
+    return bestMove;
+}
+
+// Suggest and make a move.
+static void suggestAndMakeMove(chBoard board, bool white, uint8 maxDifficulty, uint32 milliseconds,
+        uint64 nodeLimit, char *myName, char *myPossessive, char *yourPossessive) {
+    uint32 moveNum = chBoardGetUndoMovePos(board);
+    uint64 movesEvaluated;
+    uint8 difficulty;
+    uint64 startTime = getTimeMs();
+    chMove move = searchIteratively(board, white, maxDifficulty, milliseconds, nodeLimit,
+            &difficulty, &movesEvaluated);
+    chPiece piece = getPieceAtPosition(board, moveFromRow(move), moveFromCol(move));
+    printf("%u) %s move %s %s from %c%d to %c%u", moveNum, myName, myPossessive,
+            getPieceTypeName(getPieceType(piece)), moveFromCol(move) + 'a',
+            moveFromRow(move) + 1, moveToCol(move) + 'a', moveToRow(move) + 1);
+    chPiece target = getPieceAtPosition(board, moveToRow(move), moveToCol(move));
+    uint16 flags = move & MOVE_FLAGS;
+    if (target != chPieceNull) {
+        printf(" taking %s %s", yourPossessive, getPieceTypeName(getPieceType(target)));
+    } else if (flags == MOVE_EN_PASSANT) {
+        printf(" taking %s pawn en passant", yourPossessive);
+    } else if (flags == MOVE_CASTLE) {
+        printf(" castling");
+    }
+    if (flags & MOVE_PROMOTION) {
+        printf(" and promoting it to a %s", getPieceTypeName(movePromotionType(move)));
+    }
+    putchar('\n');
+    printf("Evaluated %llu moves at difficulty %u in %llu ms\n", (unsigned long long)movesEvaluated,
+            difficulty, (unsigned long long)(getTimeMs() - startTime));
+    makeGameMove(board, move);
+}
+
+// Read the move from the player and return it.  If it starts with 'u', undo two
+// moves, and try again.
+static void letPlayerMove(chBoard board, bool playerWhite, uint32 difficulty) {
+    chMove move;
+    bool undo = false;
+    do {
+        move = readPlayerMove(board, playerWhite, &undo);
+        if (undo) {
+            // Player wants to undo the last two moves.
+            if (chBoardGetUndoMovePos(board) < 2) {
+                printf("No moves left to undo.\n");
+            } else {
+                undoGameMove(board);
+                undoGameMove(board);
+            }
+        }
+        if (undo) {
+            printBoard(board);
+        }
+    } while (undo);
+    makeGameMove(board, move);
+}
+
+// Positions for the bench and SMP benchmark.
+static char *benchFens[] = {
+    START_FEN,
+    "r1bqkbnr/1ppp1ppp/p1n5/1B2p3/4P3/5N2/PPPP1PPP/RNBQK2R w KQkq - 0 4",
+    "rnbqk2r/pppp1ppp/4pn2/8/1bPP4/2N5/PP2PPPP/R1BQKBNR w KQkq - 2 4",
+    "rnbqkb1r/pp2pppp/3p1n2/8/3NP3/2N5/PPP2PPP/R1BQKB1R b KQkq - 2 5",
+    "rnb1k2r/pppnqppp/4p3/3pP3/3P4/2N5/PPP2PPP/R2QKBNR w KQkq - 0 7",
+    "rn1qk2r/pp3ppp/2p1pn2/5b2/PbBP4/2N1PN2/1P3PPP/R1BQK2R w KQkq - 1 8",
+    "r1b1kb1r/p1ppqppp/2p5/3nP3/8/8/PPP1QPPP/RNB1KB1R w KQkq - 2 8",
+    "r1bqk2r/ppp1bppp/1nn5/4p3/8/2N2NP1/PP1PPPBP/R1BQ1RK1 w kq - 5 8",
+};
+
+// Make a list of moves like "e2 e4,e7 e5" on the board.  Return true if it is
+// then white's turn.
+static bool playMoves(chBoard board, bool whitesTurn, char *moves) {
+    while (*moves != '\0') {
+        char text[MAX_MOVE_TEXT];
+        chMove move = NULL_MOVE;
+        size_t length = strcspn(moves, ",");
+        length = length < MAX_MOVE_TEXT - 1? length : MAX_MOVE_TEXT - 1;
+        memcpy(text, moves, length);
+        text[length] = '\0';
+        if (!parseMove(board, text, &move) || !moveLegal(board, move, whitesTurn)) {
+            utExit("Invalid move %s", text);
+        }
+        makeGameMove(board, move);
+        whitesTurn = !whitesTurn;
+        moves += strlen(text);
+        if (*moves == ',') {
+            moves++;
+        }
+    }
+    return whitesTurn;
+}
+
+// Create a board with the position from the FEN, or the starting position if
+// fen is NULL, then make the moves.  Set *retWhitesTurn to true if it is then
+// white's turn.
+static chBoard createPosition(bool playerWhite, char *fen, char *moves, bool *retWhitesTurn) {
+    if (fen == NULL) {
+        chBoard board = chBoardCreate(playerWhite);
+        *retWhitesTurn = playMoves(board, true, moves);
+        return board;
+    }
+    chBoard board = chBoardCreateEmpty(playerWhite);
+    bool whitesTurn = true;
+    if (!loadFen(board, fen, &whitesTurn)) {
+        utExit("Invalid FEN %s", fen);
+    }
+    *retWhitesTurn = playMoves(board, whitesTurn, moves);
+    return board;
+}
+
+// Search each benchmark position to the given difficulty, starting with an
+// empty transposition table, and return the total milliseconds taken.
+static uint64 timeSmpBench(uint8 difficulty, uint64 *retMovesEvaluated) {
+    uint64 totalTime = 0;
+    *retMovesEvaluated = 0;
+    for (uint32 i = 0; i < sizeof(benchFens)/sizeof(char *); i++) {
+        bool whitesTurn;
+        chBoard board = createPosition(true, benchFens[i], "", &whitesTurn);
+        clearTranspositionTable();
+        srand(1);
+        uint64 startTime = getTimeMs();
+        uint8 reachedDifficulty;
+        uint64 movesEvaluated;
+        searchIteratively(board, whitesTurn, difficulty, 0, 0, &reachedDifficulty, &movesEvaluated);
+        totalTime += getTimeMs() - startTime;
+        *retMovesEvaluated += movesEvaluated;
+    }
+    return totalTime;
+}
+
+// Report the time to reach the difficulty with one thread and with threads
+// threads, and the speedup.
+static void runSmpBench(uint8 difficulty, uint32 threads) {
+    uint64 movesEvaluated;
+    numSearchThreads = 1;
+    uint64 oneThreadTime = timeSmpBench(difficulty, &movesEvaluated);
+    printf("1 thread: %llu ms, %llu moves evaluated\n", (unsigned long long)oneThreadTime,
+            (unsigned long long)movesEvaluated);
+    numSearchThreads = threads;
+    uint64 time = timeSmpBench(difficulty, &movesEvaluated);
+    printf("%u threads: %llu ms, %llu moves evaluated\n", threads, (unsigned long long)time,
+            (unsigned long long)movesEvaluated);
+    printf("Time to difficulty %u speedup: %.2fx\n", difficulty,
+            (double)oneThreadTime/(time != 0? time : 1));
+}
+
+// Search each bench position to the difficulty with one thread, an empty
+// transposition table and history, and no randomization.  Report the total
+// moves evaluated, which only changes when the search does, and the time and
+// moves per second.
+static void runBench(uint8 difficulty) {
+    uint64 totalMovesEvaluated = 0;
+    uint64 totalTime = 0;
+    numSearchThreads = 1;
+    searchRandomized = false;
+    for (uint32 i = 0; i < sizeof(benchFens)/sizeof(char *); i++) {
+        bool whitesTurn;
+        chBoard board = createPosition(true, benchFens[i], "", &whitesTurn);
+        clearTranspositionTable();
+        memset(historyScores, 0, sizeof(historyScores));
+        uint64 startTime = getTimeMs();
+        uint8 reachedDifficulty;
+        uint64 movesEvaluated;
+        searchIteratively(board, whitesTurn, difficulty, 0, 0, &reachedDifficulty, &movesEvaluated);
+        uint64 time = getTimeMs() - startTime;
+        printf("Position %u: %llu moves in %llu ms\n", i + 1, (unsigned long long)movesEvaluated,
+                (unsigned long long)time);
+        totalMovesEvaluated += movesEvaluated;
+        totalTime += time;
+    }
+    printf("Bench at difficulty %u: %llu moves evaluated in %llu ms (%llu moves/sec)\n", difficulty,
+            (unsigned long long)totalMovesEvaluated, (unsigned long long)totalTime,
+            (unsigned long long)(totalMovesEvaluated*1000/(totalTime != 0? totalTime : 1)));
+}
+
+// Count the leaf nodes depth moves ahead, which measures the legal move
+// generator and makeMove/undoMove against known perft counts.
+static uint64 perft(chBoard board, bool whitesTurn, uint8 depth) {
+    if (depth == 0) {
+        return 1;
+    }
+    uint64 nodes = 0;
+    chMoveList list;
+    findAllMoves(board, whitesTurn, &list);
+    for (uint32 i = 0; i < list.numMoves; i++) {
+        makeMove(board, list.moves[i]);
+        utAssert(!kingInCheck(board, whitesTurn));
+        nodes += perft(board, !whitesTurn, depth - 1);
+        undoMove(board);
+    }
+    return nodes;
+}
+
+// Run perft on the position reached by playing moves from the FEN, and
+// report the leaf nodes, time taken, and nodes per second.  If divide is true,
+// also report the leaf nodes under each root move.
+static void runPerft(uint8 depth, char *fen, char *moves, bool divide) {
+    bool whitesTurn;
+    chBoard board = createPosition(true, fen, moves, &whitesTurn);
+    uint64 startTime = getTimeMs();
+    uint64 nodes = 0;
+    if (!divide || depth == 0) {
+        nodes = perft(board, whitesTurn, depth);
+    } else {
+        chMoveList list;
+        findAllMoves(board, whitesTurn, &list);
+        for (uint32 i = 0; i < list.numMoves; i++) {
+            chMove move = list.moves[i];
+            makeMove(board, move);
+            uint64 moveNodes = perft(board, !whitesTurn, depth - 1);
+            char text[MAX_MOVE_TEXT];
+            writeMove(move, text);
+            printf("%s: %llu\n", text, (unsigned long long)moveNodes);
+            nodes += moveNodes;
+            undoMove(board);
+        }
+    }
+    uint64 time = getTimeMs() - startTime;
+    printf("Perft %u: %llu nodes in %llu ms (%llu nodes/sec)\n", depth, (unsigned long long)nodes,
+            (unsigned long long)time, (unsigned long long)(nodes*1000/(time != 0? time : 1)));
+}
+
+int main(int argc, char **argv) {
+    int xArg = 1;
+    utStart();
+    chDatabaseStart();
+    initAttackTables();
+    initZobristKeys();
+    initPieceSquareScores();
+    initPawnMasks();
+    bool playerWhite = true;
+    bool autoPlay = false;
+    uint8 difficulty = 5;
+    int32 seed = 2;
+    uint32 moveLimit = UINT32_MAX;
+    uint32 hashMegabytes = TT_DEFAULT_MEGABYTES;
+    uint32 milliseconds = 0;
+    uint64 nodeLimit = 0;
+    bool difficultySet = false;
+    bool smpBench = false;
+    bool bench = false;
+    int32 perftDepth = -1;
+    bool divide = false;
+    char *fen = NULL;
+    char *moves = "";
+    char *networkFile = NULL;
+    while (xArg < argc && argv[xArg][0] == '-') {
+        if (!strcmp(argv[xArg], "-a")) {
+            autoPlay = true;
+        } else if (!strcmp(argv[xArg], "-n")) {
             xArg++;
             if (xArg < argc) {
                 moveLimit = atoi(argv[xArg]);
             }
+        } else if (!strcmp(argv[xArg], "-hash")) {
+            xArg++;
+            if (xArg < argc) {
+                hashMegabytes = atoi(argv[xArg]);
+            }
+        } else if (!strcmp(argv[xArg], "-d")) {
+            xArg++;
+            if (xArg < argc) {
+                difficulty = utMax(0, utMin(MAX_DIFFICULTY, atoi(argv[xArg])));
+                difficultySet = true;
+            }
+        } else if (!strcmp(argv[xArg], "-ms")) {
+            xArg++;
+            if (xArg < argc) {
+                milliseconds = atoi(argv[xArg]);
+            }
+        } else if (!strcmp(argv[xArg], "-nodes")) {
+            xArg++;
+            if (xArg < argc) {
+                nodeLimit = strtoull(argv[xArg], NULL, 10);
+            }
+        } else if (!strcmp(argv[xArg], "-t")) {
+            xArg++;
+            if (xArg < argc) {
+                numSearchThreads = utMax(1, utMin(MAX_THREADS, atoi(argv[xArg])));
+            }
+        } else if (!strcmp(argv[xArg], "-nopvs")) {
+            searchPvs = false;
+        } else if (!strcmp(argv[xArg], "-noaspiration")) {
+            searchAspiration = false;
+        } else if (!strcmp(argv[xArg], "-nonull")) {
+            searchNullMove = false;
+        } else if (!strcmp(argv[xArg], "-nolmr")) {
+            searchLmr = false;
+        } else if (!strcmp(argv[xArg], "-nofutility")) {
+            searchFutility = false;
+        } else if (!strcmp(argv[xArg], "-norazor")) {
+            searchRazoring = false;
+        } else if (!strcmp(argv[xArg], "-nosee")) {
+            searchExchanges = false;
+        } else if (!strcmp(argv[xArg], "-nnue")) {
+            xArg++;
+            if (xArg < argc) {
+                networkFile = argv[xArg];
+            }
+        } else if (!strcmp(argv[xArg], "-smpbench")) {
+            smpBench = true;
+        } else if (!strcmp(argv[xArg], "-bench")) {
+            bench = true;
+        } else if (!strcmp(argv[xArg], "-perft") || !strcmp(argv[xArg], "-divide")) {
+            divide = !strcmp(argv[xArg], "-divide");
+            xArg++;
+            if (xArg < argc) {
+                perftDepth = atoi(argv[xArg]);
+            }
+        } else if (!strcmp(argv[xArg], "-audit")) {
+            xArg++;
+            if (xArg < argc) {
+                searchAuditInterval = strtoull(argv[xArg], NULL, 10);
+            }
+        } else if (!strcmp(argv[xArg], "-fen")) {
+            xArg++;
+            if (xArg < argc) {
+                fen = argv[xArg];
+            }
+        } else if (!strcmp(argv[xArg], "-moves")) {
+            xArg++;
+            if (xArg < argc) {
+                moves = argv[xArg];
+            }
         }
         xArg++;
     }
+    if (!difficultySet && (milliseconds != 0 || nodeLimit != 0)) {
+        // Let the budget decide how deep to search.
+        difficulty = MAX_DIFFICULTY;
+    }
+    if (perftDepth >= 0) {
+        runPerft(perftDepth, fen, moves, divide);
+        chDatabaseStop();
+        utStop(false);
+        return 0;
+    }
+    if (networkFile != NULL) {
+        loadNetwork(networkFile);
+    }
+    initTranspositionTable(hashMegabytes);
+    if (bench) {
+        runBench(difficultySet? difficulty : BENCH_DIFFICULTY);
+        freeTranspositionTable();
+        chDatabaseStop();
+        utStop(false);
+        return 0;
+    }
+    if (smpBench) {
+        runSmpBench(difficulty, numSearchThreads);
+        freeTranspositionTable();
+        chDatabaseStop();
+        utStop(false);
+        return 0;
+    }
     if (!autoPlay) {
         seed = atoi(readline("Enter a game seed as an integer: "));
     }
     srand(seed);
     if (!autoPlay) {
         char* response = readline("How many moves ahead should the computer look? ");
-        difficulty = atoi(response);
+        difficulty = utMax(0, utMin(MAX_DIFFICULTY, atoi(response)));
         response = readline("Would you prefer to play white (enter 'a' for auto-play)? (y/n/a) ");
         while (*response != 'y' && *response != 'n' && *response != 'a') {
             response = readline("Only y and n are allowed.  Whould you like to play white? (y/n) ");
@@ -857,46 +3673,46 @@ int main(int argc, char **argv) {
             autoPlay = true;
         }
     }
-    chBoard board = chBoardCreate(playerWhite);
+    bool whitesTurn;
+    chBoard board = createPosition(playerWhite, fen, moves, &whitesTurn);
     printBoard(board);
-    bool playersTurn = playerWhite;
-    uint32 initialMovesEvaluated = 0;
+    bool playersTurn = whitesTurn == playerWhite;
     uint32 numMoves = 0;
-    while (!gameOver(board) && numMoves < moveLimit) {
-        verifyScore(board);
-        uint32 movesEvaluated;
+    bool checkmate = false;
+    char *draw = NULL;
+    while (!gameOver(board, playersTurn == playerWhite, &checkmate, &draw) && numMoves < moveLimit) {
+        if (searchAuditInterval != 0) {
+            auditBoard(board, playersTurn == playerWhite);
+        }
         if (playersTurn) {
             if (autoPlay) {
-                suggestAndMakeMove(board, playerWhite, difficulty, "You", "your", "my", &movesEvaluated);
+                suggestAndMakeMove(board, playerWhite, difficulty, milliseconds, nodeLimit,
+                        "You", "your", "my");
             } else {
                 letPlayerMove(board, playerWhite, difficulty);
             }
         } else {
-            suggestAndMakeMove(board, !playerWhite, difficulty, "I", "my", "your", &movesEvaluated);
-            if (initialMovesEvaluated == 0) {
-                initialMovesEvaluated = movesEvaluated;
-            }
-            if (movesEvaluated > 5*initialMovesEvaluated) {
-                difficulty--;
-                printf("Decreasing difficulty to %u\n", difficulty);
-            } else if (5*movesEvaluated < initialMovesEvaluated) {
-                difficulty++;
-                printf("Increasing difficulty to %u\n", difficulty);
-            }
+            suggestAndMakeMove(board, !playerWhite, difficulty, milliseconds, nodeLimit,
+                    "I", "my", "your");
         }
         printBoard(board);
         playersTurn = !playersTurn;
-        int32 score = playerWhite? chBoardGetWhiteScore(board) - chBoardGetBlackScore(board) :
-                chBoardGetBlackScore(board) - chBoardGetWhiteScore(board);
+        int32 score = findStaticScore(board, playerWhite);
         printf("Score = %.3f\n", 0.001*score);
         fflush(stdout);
         numMoves++;
     }
-    if (!playersTurn) {
+    printGameRecord(board);
+    if (draw != NULL) {
+        printf("%s.  It's a draw.\n", draw);
+    } else if (!checkmate) {
+        printf("Stopped after %u moves, with the game unfinished.\n", numMoves);
+    } else if (!playersTurn) {
         printf("You win!\n");
     } else {
         printf("Sorry, better luck next time.\n");
     }
+    freeTranspositionTable();
     chDatabaseStop();
     utStop(false);
     return 0;
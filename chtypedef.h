@@ -1,13 +1,9 @@
 #include <ddutil.h>
 
-struct chMove_st {
-    uint8 fromRow;
-    uint8 fromCol;
-    uint8 toRow;
-    uint8 toCol;
-};
-
-typedef struct chMove_st chMove;
+// A move packed in 16 bits: the from square in bits 0-5, the to square in bits
+// 6-11, and flags for castling, en passant and promotion in bits 12-15.
+// Squares are 8*row + col.
+typedef uint16 chMove;
 
 #if (defined(DD_DEBUG) && !defined(DD_NOSTRICT)) || defined(DD_STRICT)
 typedef struct _struct_chPiece{char val;} *chPiece;
@@ -17,9 +13,35 @@ typedef uint32 chPiece;
 
 struct chUndoMove_st {
     chMove move;  // The original move.
-    chPiece target;  // The piece taken, or castle if castling.
-    bool queenedPawn;
+    chPiece target;  // The piece taken, including by en passant.
     bool firstMove;
+    uint8 enPassantSquare;  // The board's en passant square before the move.
+    uint16 halfMoveClock;  // The board's half-move clock before the move.
+    uint64 hash;  // The board's hash before the move.
 };
 
 typedef struct chUndoMove_st chUndoMove;
+
+// Bit 8*row + col is set for each occupied square.  (0, 0) is bottom left.
+// These are the per-colour, per-type piece sets: move generation walks them
+// rather than the board's piece list, so it only visits live pieces of the side
+// to move.  setPieceAtPosition and removePieceAtPosition keep them current, so
+// undoMove restores them.
+struct chBitboards_st {
+    uint64 pieces[2][6];  // Indexed by [white][chPieceType].
+    uint64 colors[2];  // All pieces of one colour, indexed by white.
+    uint64 occupied;
+};
+
+typedef struct chBitboards_st chBitboards;
+
+// The first layer of the neural network evaluation: for each side's point of
+// view, the sum of the weights of the pieces on their squares, without the
+// biases.  setPieceAtPosition and removePieceAtPosition keep it current while
+// a network is loaded, so undoMove restores it.
+#define NNUE_HIDDEN 128
+struct chAccumulator_st {
+    int16 values[2][NNUE_HIDDEN];  // Indexed by [white].
+};
+
+typedef struct chAccumulator_st chAccumulator;